@@ -0,0 +1,256 @@
+/*
+* audiodemux.cc -- Writes the audio of HDV captures to separate files
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "audiodemux.h"
+#include "error.h"
+#include "iec13818-1.h"
+#include "stringutils.h"
+
+
+AudioDemuxer::AudioDemuxer() : isOpen( false ), current( NULL ), stopping( false ), fd( -1 ), isPESStarted( false )
+{
+	pthread_mutex_init( &mutex, NULL );
+	pthread_cond_init( &jobQueued, NULL );
+	fail_neg( pthread_create( &thread, NULL, WorkerThread, this ) );
+}
+
+
+AudioDemuxer::~AudioDemuxer()
+{
+	Close();
+
+	pthread_mutex_lock( &mutex );
+	stopping = true;
+	pthread_cond_signal( &jobQueued );
+	pthread_mutex_unlock( &mutex );
+	pthread_join( thread, NULL );
+
+	for ( unsigned int i = 0; i < jobs.size(); ++i )
+		delete jobs[ i ];
+	pthread_cond_destroy( &jobQueued );
+	pthread_mutex_destroy( &mutex );
+}
+
+
+/** Starts the audio file of a video file
+
+    \param videoName the video file
+*/
+
+void AudioDemuxer::Open( const std::string &videoName )
+{
+	Close();
+	AudioJob *job = GetJob();
+	job->type = AudioJob::OPEN;
+	job->name = StringUtils::replaceExtension( videoName, ".mp2" );
+	Queue( job );
+	isOpen = true;
+}
+
+
+/** Ends the audio file once everything added so far is written
+
+    This does not wait for the thread.
+*/
+
+void AudioDemuxer::Close()
+{
+	if ( !isOpen )
+		return;
+	Commit();
+	AudioJob *job = GetJob();
+	job->type = AudioJob::CLOSE;
+	Queue( job );
+	isOpen = false;
+}
+
+
+/** Copies the packets of the audio PID from the data of the video file
+
+    \param data whole TS packets
+    \param length the bytes of data
+    \param pid the audio PID, 0 if not known yet
+
+    Packets added before Open() go to the file it starts, as the video
+    file gets the frames buffered until it is created.
+*/
+
+void AudioDemuxer::Add( unsigned char *data, int length, int pid )
+{
+	if ( pid == 0 )
+		return;
+	if ( current == NULL )
+	{
+		current = GetJob();
+		current->type = AudioJob::PACKETS;
+	}
+	for ( int i = 0; i + HDV_PACKET_SIZE <= length; i += HDV_PACKET_SIZE )
+		if ( data[ i ] == HDV_PACKET_MARKER && ( ( ( data[ i + 1 ] & 0x1f ) << 8 ) | data[ i + 2 ] ) == pid )
+			current->packets.insert( current->packets.end(), data + i, data + i + HDV_PACKET_SIZE );
+}
+
+
+/// Hands the packets added since the last call to the thread, drops them without a file
+void AudioDemuxer::Commit()
+{
+	if ( current == NULL )
+		return;
+	if ( current->packets.empty() || !isOpen )
+	{
+		pthread_mutex_lock( &mutex );
+		freeJobs.push_back( current );
+		pthread_mutex_unlock( &mutex );
+	}
+	else
+	{
+		Queue( current );
+	}
+	current = NULL;
+}
+
+
+AudioJob *AudioDemuxer::GetJob()
+{
+	AudioJob *job = NULL;
+
+	pthread_mutex_lock( &mutex );
+	if ( !freeJobs.empty() )
+	{
+		job = freeJobs.front();
+		freeJobs.pop_front();
+	}
+	pthread_mutex_unlock( &mutex );
+
+	if ( job == NULL )
+	{
+		job = new AudioJob;
+		jobs.push_back( job );
+	}
+	job->packets.clear();
+	return job;
+}
+
+
+void AudioDemuxer::Queue( AudioJob *job )
+{
+	pthread_mutex_lock( &mutex );
+	queue.push_back( job );
+	pthread_cond_signal( &jobQueued );
+	pthread_mutex_unlock( &mutex );
+}
+
+
+/** Takes queued jobs until the demuxer is destroyed and the queue is empty */
+
+void *AudioDemuxer::WorkerThread( void *arg )
+{
+	AudioDemuxer *demuxer = static_cast< AudioDemuxer* >( arg );
+
+	pthread_mutex_lock( &demuxer->mutex );
+	while ( true )
+	{
+		while ( demuxer->queue.empty() && !demuxer->stopping )
+			pthread_cond_wait( &demuxer->jobQueued, &demuxer->mutex );
+		if ( demuxer->queue.empty() )
+			break;
+		AudioJob *job = demuxer->queue.front();
+		demuxer->queue.pop_front();
+		pthread_mutex_unlock( &demuxer->mutex );
+
+		demuxer->Process( job );
+
+		pthread_mutex_lock( &demuxer->mutex );
+		demuxer->freeJobs.push_back( job );
+	}
+	pthread_mutex_unlock( &demuxer->mutex );
+	return NULL;
+}
+
+
+/** Does a job on the demuxer thread
+
+    A file starts with the first PES packet, so it starts with a whole
+    audio frame.
+*/
+
+void AudioDemuxer::Process( AudioJob *job )
+{
+	switch ( job->type )
+	{
+	case AudioJob::OPEN:
+		name = job->name;
+		fd = open( name.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644 );
+		if ( fd == -1 )
+			sendEvent( ">>> Error creating file %s: %s", name.c_str(), strerror( errno ) );
+		isPESStarted = false;
+		break;
+
+	case AudioJob::PACKETS:
+		output.clear();
+		for ( unsigned int i = 0; i + HDV_PACKET_SIZE <= job->packets.size(); i += HDV_PACKET_SIZE )
+		{
+			unsigned char *packet = &job->packets[ i ];
+			unsigned char *payload;
+			int length;
+			long long pts;
+
+			if ( !( payload = GetTSPayload( packet, length ) ) )
+				continue;
+			if ( packet[ 1 ] & 0x40 )
+			{
+				if ( !( payload = SkipPESHeader( payload, length, pts ) ) )
+					continue;
+				isPESStarted = true;
+			}
+			if ( isPESStarted )
+				output.insert( output.end(), payload, payload + length );
+		}
+		for ( size_t written = 0; fd != -1 && written < output.size(); )
+		{
+			ssize_t n = write( fd, &output[ written ], output.size() - written );
+			if ( n < 0 && errno == EINTR )
+				continue;
+			if ( n <= 0 )
+			{
+				sendEvent( ">>> Error writing file %s: %s", name.c_str(), strerror( errno ) );
+				close( fd );
+				fd = -1;
+				break;
+			}
+			written += n;
+		}
+		break;
+
+	case AudioJob::CLOSE:
+		if ( fd != -1 )
+			close( fd );
+		fd = -1;
+		break;
+	}
+}
@@ -0,0 +1,88 @@
+/*
+* audiodemux.h -- Writes the audio of HDV captures to separate files
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DVGRAB_AUDIODEMUX_H
+#define DVGRAB_AUDIODEMUX_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+/** Work for the demuxer thread, in the order it was queued */
+
+struct AudioJob
+{
+	enum { OPEN, PACKETS, CLOSE } type;
+	/// the file to open
+	std::string name;
+	/// whole TS packets of the audio PID
+	std::vector< unsigned char > packets;
+};
+
+/** Writes the audio elementary stream of an HDV file next to it
+
+    The audio of foo-001.m2t goes to foo-001.mp2 as it was recorded,
+    MPEG audio without the PES headers, which any audio tool reads
+    without the video having to be read again.
+
+    The capture thread only copies the packets of the audio PID, which
+    are a few percent of the stream. A thread of its own takes the PES
+    packets apart and writes the file, so the video file never waits
+    for it. Jobs are not limited in number: if the disk stalls, memory
+    grows rather than the capture.
+*/
+
+class AudioDemuxer
+{
+public:
+	AudioDemuxer();
+	~AudioDemuxer();
+
+	void Open( const std::string &videoName );
+	void Close();
+	void Add( unsigned char *data, int length, int pid );
+	void Commit();
+
+private:
+	static void *WorkerThread( void *arg );
+	AudioJob *GetJob();
+	void Queue( AudioJob *job );
+	void Process( AudioJob *job );
+
+	bool isOpen;
+	/// the job Add fills, queued by Commit
+	AudioJob *current;
+	std::vector< AudioJob* > jobs;
+	std::deque< AudioJob* > freeJobs;
+	std::deque< AudioJob* > queue;
+	bool stopping;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t jobQueued;
+
+	// owned by the thread
+	int fd;
+	std::string name;
+	bool isPESStarted;
+	std::vector< unsigned char > output;
+};
+
+#endif
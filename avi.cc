@@ -396,6 +396,9 @@ int AVIFile::GetFrame( Frame *frame, int frameNum )
 		return -1;
 	fail_if( lseek( fd, offset, SEEK_SET ) == ( off_t ) - 1 );
 	fail_neg( read( fd, frame->data, size ) );
+	frame->SetDataLen( size );
+	frame->sourceFd = fd;
+	frame->sourceOffset = offset;
 
 	return 0;
 }
@@ -849,6 +852,74 @@ void AVIFile::UpdateIdx1( int chunk, int flags )
 	}
 }
 
+/** Calculates where WriteFrame will put the next chunk
+ 
+    \return the file offset of the header of the next chunk in the movi list
+*/
+
+off_t AVIFile::GetNextChunkOffset( void )
+{
+	RIFFDirEntry movi = GetDirectoryEntry( movi_list );
+	off_t offset = movi.offset + movi.length;
+
+	/* WriteFrame first starts a new Standard Index per stream if the
+	   current ones are full */
+
+	if ( ( index_type & AVI_LARGE_INDEX ) && ( streamHdr[ 0 ].dwLength % IX00_INDEX_SIZE ) == 0 )
+		offset += mainHdr.dwStreams * ( RIFF_HEADERSIZE + sizeof( AVIStdIndex ) );
+	return offset;
+}
+
+
+/** Makes the file on disk playable while it is still being written
+ 
+    Writes the current headers and indexes and the lengths of all
+    lists, so that a capture which is interrupted before Close() loses
+    at most the frames written since the last checkpoint. The cost is
+    bounded by the size of the headers and of the indexes, it does
+    not depend on the size of the file.
+ 
+    The idx1 chunk belongs after the movi list of the first RIFF. As
+    long as that RIFF is still growing, a provisional copy is written
+    there and included in the RIFF length. The following frames are
+    written after it, and the next checkpoint turns it into a JUNK
+    chunk of the movi list, so whatever the point of an interruption
+    the RIFF length ends on a complete idx1. This costs the size of
+    idx1 at every checkpoint, at most a few MB per GB of video.
+*/
+
+void AVIFile::Checkpoint( void )
+{
+	if ( streamHdr[ 0 ].dwLength == 0 )
+		return ;
+
+	WriteHeaders();
+	RIFFFile::CheckpointRIFF();
+
+	if ( ( index_type & AVI_SMALL_INDEX ) && isUpdateIdx1 )
+	{
+		RIFFDirEntry riff = GetDirectoryEntry( riff_list );
+		FOURCC type = make_fourcc( "idx1" );
+		DWORD length = idx1->nEntriesInUse * 16;
+		DWORD riffLength = riff.length + RIFF_HEADERSIZE + length;
+
+		fail_if( lseek( fd, riff.offset + riff.length, SEEK_SET ) == ( off_t ) - 1 );
+		fail_neg( write( fd, &type, sizeof( type ) ) );
+		fail_neg( write( fd, &length, sizeof( length ) ) );
+		fail_neg( write( fd, idx1, idx1->nEntriesInUse * 16 ) );
+
+		fail_if( lseek( fd, riff.offset - sizeof( riffLength ), SEEK_SET ) == ( off_t ) - 1 );
+		fail_neg( write( fd, &riffLength, sizeof( riffLength ) ) );
+
+		/* Reserve its place in the movi list, the header on disk stays
+		   idx1 until CheckpointRIFF() or WriteRIFF() writes it as JUNK */
+		AddDirectoryEntry( make_fourcc( "JUNK" ), 0, length, movi_list );
+	}
+
+	fail_neg( fdatasync( fd ) );
+}
+
+
 bool AVIFile::verifyStreamFormat( FOURCC type )
 {
 	int i, j = 0;
@@ -1174,9 +1245,8 @@ bool AVI1File::WriteFrame( Frame *frame )
 }
 
 
-void AVI1File::WriteRIFF()
+void AVI1File::WriteHeaders()
 {
-
 	WriteChunk( avih_chunk, ( void* ) & mainHdr );
 	WriteChunk( strh_chunk[ 0 ], ( void* ) & streamHdr[ 0 ] );
 	WriteChunk( strf_chunk[ 0 ], ( void* ) & dvinfo );
@@ -1187,6 +1257,12 @@ void AVI1File::WriteRIFF()
 		WriteChunk( indx_chunk[ 0 ], ( void* ) indx[ 0 ] );
 		WriteChunk( ix_chunk[ 0 ], ( void* ) ix[ 0 ] );
 	}
+}
+
+
+void AVI1File::WriteRIFF()
+{
+	WriteHeaders();
 
 	if ( ( index_type & AVI_SMALL_INDEX ) && isUpdateIdx1 )
 	{
@@ -1396,7 +1472,7 @@ void AVI2File::Init( int format, int sampleFrequency, int indexType )
 }
 
 
-void AVI2File::WriteRIFF()
+void AVI2File::WriteHeaders()
 {
 	WriteChunk( avih_chunk, ( void* ) & mainHdr );
 	WriteChunk( strh_chunk[ 0 ], ( void* ) & streamHdr[ 0 ] );
@@ -1414,6 +1490,12 @@ void AVI2File::WriteRIFF()
 		WriteChunk( indx_chunk[ 1 ], ( void* ) indx[ 1 ] );
 		WriteChunk( ix_chunk[ 1 ], ( void* ) ix[ 1 ] );
 	}
+}
+
+
+void AVI2File::WriteRIFF()
+{
+	WriteHeaders();
 
 	if ( ( index_type & AVI_SMALL_INDEX ) && isUpdateIdx1 )
 	{
@@ -233,9 +233,13 @@ public:
 	virtual void ReadIndex( void );
 	virtual void WriteRIFF( void )
 	{ }
+	virtual void WriteHeaders( void )
+	{ }
+	virtual void Checkpoint( void );
 	virtual void FlushIndx( int stream );
 	virtual void UpdateIndx( int stream, int chunk, int duration );
 	virtual void UpdateIdx1( int chunk, int flags );
+	virtual off_t GetNextChunkOffset( void );
 	virtual bool verifyStreamFormat( FOURCC type );
 	virtual bool verifyStream( FOURCC type );
 	virtual bool isOpenDML( void );
@@ -286,6 +290,7 @@ public:
 
 	virtual void Init( int format, int sampleFrequency, int indexType );
 	virtual bool WriteFrame( Frame *frame );
+	virtual void WriteHeaders( void );
 	virtual void WriteRIFF( void );
 	virtual void setDVINFO( DVINFO& );
 
@@ -316,6 +321,7 @@ public:
 
 	virtual void Init( int format, int sampleFrequency, int indexType );
 	virtual bool WriteFrame( Frame *frame );
+	virtual void WriteHeaders( void );
 	virtual void WriteRIFF( void );
 	virtual void setDVINFO( DVINFO& );
 
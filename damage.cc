@@ -0,0 +1,79 @@
+/*
+* damage.cc -- Class for writing DV damage logs
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iomanip>
+
+#include "damage.h"
+#include "stringutils.h"
+
+void DamageWriter::openFile()
+{
+	logName = StringUtils::replaceExtension( videoName, ".damage" );
+
+	os.close();
+	os.clear();
+	os.open( logName.c_str() );
+	os << "# frame\ttimecode\tblocks\tpermille\tmap\n";
+}
+
+
+/** Logs a frame if it has damaged DIF blocks
+
+    Each line holds the number of the frame in the video file, its
+    timecode, the number of damaged DIF blocks, their share of all
+    blocks in the frame and the damage map in hex.
+
+    \param videoName the file the frame was written to
+    \param frameNum the number of the frame in that file, starting at 0
+    \param frame the frame
+*/
+
+void DamageWriter::addFrame( const char *videoName, int frameNum, DVFrame &frame )
+{
+	unsigned char map[ DV_DAMAGE_MAP_SIZE ];
+	int damaged = frame.GetDamage( map );
+
+	if ( this->videoName != videoName )
+	{
+		this->videoName = videoName;
+		os.close();
+		logName.clear();
+	}
+	if ( damaged == 0 )
+		return;
+	if ( logName.empty() )
+		openFile();
+
+	TimeCode tc;
+	int blocks = frame.IsPAL() ? 12 * 150 : 10 * 150;
+
+	frame.GetTimeCode( tc );
+	os << frameNum << '\t' << std::setfill( '0' )
+	<< std::setw( 2 ) << tc.hour << ':' << std::setw( 2 ) << tc.min << ':'
+	<< std::setw( 2 ) << tc.sec << ':' << std::setw( 2 ) << tc.frame << '\t'
+	<< damaged << '\t' << damaged * 1000 / blocks << '\t' << std::hex;
+	for ( int i = 0; i < ( blocks + 7 ) / 8; ++i )
+		os << std::setw( 2 ) << ( int ) map[ i ];
+	os << std::dec << '\n';
+	os.flush();
+}
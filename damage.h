@@ -0,0 +1,44 @@
+/*
+* damage.h -- Class for writing DV damage logs
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DVGRAB_DAMAGE_H
+#define DVGRAB_DAMAGE_H
+
+#include <fstream>
+#include <string>
+#include "dvframe.h"
+
+/** Lists the frames with damaged DIF blocks next to the video file
+
+    The log of foo-001.dv is foo-001.damage. It is only created once a
+    damaged frame is written to the video file.
+*/
+
+class DamageWriter
+{
+	std::ofstream os;
+	std::string videoName;
+	std::string logName;
+
+	void openFile();
+public:
+	void addFrame( const char *videoName, int frameNum, DVFrame &frame );
+};
+
+#endif
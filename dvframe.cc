@@ -125,6 +125,8 @@ DVFrame::DVFrame()
 #endif
 	for ( int n = 0; n < 4; n++ )
 		audio_buffers[ n ] = ( int16_t * ) malloc( 2 * DV_AUDIO_MAX_SAMPLES * sizeof( int16_t ) );
+	packsIndexed = false;
+	headerParsed = false;
 }
 
 
@@ -142,13 +144,107 @@ DVFrame::~DVFrame()
 void DVFrame::SetDataLen( int len )
 {
 	Frame::SetDataLen( len );
+	packsIndexed = false;
+	headerParsed = false;
+}
+
+
+void DVFrame::Clear( void )
+{
+	Frame::Clear();
+	packsIndexed = false;
+	headerParsed = false;
+}
+
+
+/** parses the DV header with libdv unless already done for this data
+ 
+    Only the audio and video decoding needs the decoder state. The
+    meta-data is read from the pack index, so frames which are only
+    copied to a file are never parsed. */
+
+void DVFrame::ParseHeader( void )
+{
+	if ( !headerParsed )
+		ExtractHeader();
+}
+
+/** records where the first pack of each id is
+ 
+    One pass over the subcode, VAUX and audio DIF blocks of all DIF
+    sequences, in the order in which the GetXXXXPack functions used to
+    search them. The sections are indexed separately because the same
+    pack id, for example the recording date, can appear in several of
+    them. */
+
+void DVFrame::IndexPacks( void )
+{
+	/* number of DIF sequences is different for PAL and NTSC */
+
+	int seqCount = IsPAL() ? 12 : 10;
+
+	memset( ssybPacks, 0, sizeof( ssybPacks ) );
+	memset( vauxPacks, 0, sizeof( vauxPacks ) );
+	memset( aauxPacks, 0, sizeof( aauxPacks ) );
+
+	for ( int i = 0; i < seqCount; ++i )
+	{
+		int seq = i * 150 * 80;
+
+		/* there are two DIF blocks in the subcode section, starting at
+		   block 1. Each has 6 packets with a 3 byte header and 5 bytes
+		   of data after the 3 byte block header. */
+
+		for ( int j = 0; j < 2; ++j )
+			for ( int k = 0; k < 6; ++k )
+			{
+				int offset = seq + 1 * 80 + j * 80 + 3 + k * 8 + 3;
+				if ( ssybPacks[ data[ offset ] ] == 0 )
+					ssybPacks[ data[ offset ] ] = offset;
+			}
+
+		/* there are three DIF blocks in the VAUX section, starting at
+		   block 3. Each has 15 packets of 5 bytes without a header. */
+
+		for ( int j = 0; j < 3; ++j )
+			for ( int k = 0; k < 15; ++k )
+			{
+				int offset = seq + 3 * 80 + j * 80 + 3 + k * 5;
+				if ( vauxPacks[ data[ offset ] ] == 0 )
+					vauxPacks[ data[ offset ] ] = offset;
+			}
+
+		/* there are nine audio DIF blocks, every 16th beginning with
+		   block 6. Each starts with one packet. */
 
-	ExtractHeader();
+		for ( int j = 0; j < 9; ++j )
+		{
+			int offset = seq + 6 * 80 + j * 16 * 80 + 3;
+			if ( aauxPacks[ data[ offset ] ] == 0 )
+				aauxPacks[ data[ offset ] ] = offset;
+		}
+	}
+	packsIndexed = true;
 }
 
-bool DVFrame::IsHDV()
+
+/** looks up a pack in the pack index
+ 
+    \param index one of the pack tables filled in by IndexPacks
+    \param packNum the package id to return
+    \param pack a reference to the variable where the result is stored
+    \return true for success, false if no pack could be found */
+
+bool DVFrame::FindPack( const int *index, int packNum, Pack &pack )
 {
-	return false;
+	if ( !packsIndexed )
+		IndexPacks();
+
+	int offset = index[ packNum & 0xff ];
+	if ( offset == 0 )
+		return false;
+	memcpy( pack.data, &data[ offset ], 5 );
+	return true;
 }
 
 
@@ -182,47 +278,7 @@ bool DVFrame::GetSSYBPack( int packNum, Pack &pack )
 
 #else
 
-	/* number of DIF sequences is different for PAL and NTSC */
-
-	int seqCount = IsPAL() ? 12 : 10;
-
-	/* process all DIF sequences */
-
-	for ( int i = 0; i < seqCount; ++i )
-	{
-
-		/* there are two DIF blocks in the subcode section */
-
-		for ( int j = 0; j < 2; ++j )
-		{
-
-			/* each block has 6 packets */
-
-			for ( int k = 0; k < 6; ++k )
-			{
-
-				/* calculate address: 150 DIF blocks per sequence, 80 bytes
-				per DIF block, subcode blocks start at block 1, block and
-				packet have 3 bytes header, packet is 8 bytes long
-				(including header) */
-
-				const unsigned char *s = &data[ i * 150 * 80 + 1 * 80 + j * 80 + 3 + k * 8 + 3 ];
-				// printf("ssyb %d: %2.2x %2.2x %2.2x %2.2x %2.2x\n",
-				// j * 6 + k, s[0], s[1], s[2], s[3], s[4]);
-				if ( s[ 0 ] == packNum )
-				{
-					//					printf("GetSSYBPack[%x]: sequence %d, block %d, packet %d\n", packNum,i,j,k);
-					pack.data[ 0 ] = s[ 0 ];
-					pack.data[ 1 ] = s[ 1 ];
-					pack.data[ 2 ] = s[ 2 ];
-					pack.data[ 3 ] = s[ 3 ];
-					pack.data[ 4 ] = s[ 4 ];
-					return true;
-				}
-			}
-		}
-	}
-	return false;
+	return FindPack( ssybPacks, packNum, pack );
 #endif
 }
 
@@ -230,10 +286,8 @@ bool DVFrame::GetSSYBPack( int packNum, Pack &pack )
 /** gets a video auxiliary data packet
  
     Every DIF block in the video auxiliary data section contains 15
-    video auxiliary data packets, for a total of 45 VAUX packets. As
-    the position of a VAUX packet is fixed, we could directly look it
-    up, but I choose to walk through all data as with the other
-    GetXXXX routines.
+    video auxiliary data packets, for a total of 45 VAUX packets. The
+    first one with the requested id is taken from the pack index.
  
     \param packNum the VAUX package id to return
     \param pack a reference to the variable where the result is stored
@@ -254,46 +308,8 @@ bool DVFrame::GetVAUXPack( int packNum, Pack &pack )
 	return true;
 
 #else
-	/* number of DIF sequences is different for PAL and NTSC */
-
-	int seqCount = IsPAL() ? 12 : 10;
-
-	/* process all DIF sequences */
-
-	for ( int i = 0; i < seqCount; ++i )
-	{
-
-		/* there are three DIF blocks in the VAUX section */
-
-		for ( int j = 0; j < 3; ++j )
-		{
 
-			/* each block has 15 packets */
-
-			for ( int k = 0; k < 15; ++k )
-			{
-
-				/* calculate address: 150 DIF blocks per sequence, 80 bytes
-				per DIF block, vaux blocks start at block 3, block has 3
-				bytes header, packets have no header and are 5 bytes
-				long. */
-
-				const unsigned char *s = &data[ i * 150 * 80 + 3 * 80 + j * 80 + 3 + k * 5 ];
-				// printf("vaux %d: %2.2x %2.2x %2.2x %2.2x %2.2x\n",
-				// j * 15 + k, s[0],  s[1],  s[2],  s[3],  s[4]);
-				if ( s[ 0 ] == packNum )
-				{
-					pack.data[ 0 ] = s[ 0 ];
-					pack.data[ 1 ] = s[ 1 ];
-					pack.data[ 2 ] = s[ 2 ];
-					pack.data[ 3 ] = s[ 3 ];
-					pack.data[ 4 ] = s[ 4 ];
-					return true;
-				}
-			}
-		}
-	}
-	return false;
+	return FindPack( vauxPacks, packNum, pack );
 #endif
 }
 
@@ -301,8 +317,8 @@ bool DVFrame::GetVAUXPack( int packNum, Pack &pack )
 /** gets an audio auxiliary data packet
  
     Every DIF block in the audio section contains 5 bytes audio
-    auxiliary data and 72 bytes of audio data.  The function searches
-    through all DIF blocks although AAUX packets are only allowed in
+    auxiliary data and 72 bytes of audio data.  The pack index covers
+    all audio DIF blocks although AAUX packets are only allowed in
     certain defined DIF blocks.
  
     \param packNum the AAUX package id to return
@@ -347,40 +363,7 @@ done = true:
 		return true;
 #endif
 
-	/* number of DIF sequences is different for PAL and NTSC */
-
-	int seqCount = IsPAL() ? 12 : 10;
-
-	/* process all DIF sequences */
-
-	for ( int i = 0; i < seqCount; ++i )
-	{
-
-		/* there are nine audio DIF blocks */
-
-		for ( int j = 0; j < 9; ++j )
-		{
-
-			/* calculate address: 150 DIF blocks per sequence, 80 bytes
-			   per DIF block, audio blocks start at every 16th beginning
-			   with block 6, block has 3 bytes header, followed by one
-			   packet. */
-
-			const unsigned char *s = &data[ i * 150 * 80 + 6 * 80 + j * 16 * 80 + 3 ];
-			if ( s[ 0 ] == packNum )
-			{
-				// printf("aaux %d: %2.2x %2.2x %2.2x %2.2x %2.2x\n",
-				// j, s[0], s[1], s[2], s[3], s[4]);
-				pack.data[ 0 ] = s[ 0 ];
-				pack.data[ 1 ] = s[ 1 ];
-				pack.data[ 2 ] = s[ 2 ];
-				pack.data[ 3 ] = s[ 3 ];
-				pack.data[ 4 ] = s[ 4 ];
-				return true;
-			}
-		}
-	}
-	return false;
+	return FindPack( aauxPacks, packNum, pack );
 }
 
 
@@ -395,23 +378,20 @@ done = true:
 
 bool DVFrame::GetRecordingDate( struct tm &recDate )
 {
-#ifdef HAVE_LIBDV
-	return dv_get_recording_datetime_tm( decoder, ( struct tm * ) &recDate );
-#else
-
 	Pack pack62;
 	Pack pack63;
 
-	if ( GetSSYBPack( 0x62, pack62 ) == false )
+	/* like libdv, prefer the date in the VAUX section over the one in
+	   the subcode */
+
+	if ( !( GetVAUXPack( 0x62, pack62 ) && GetVAUXPack( 0x63, pack63 ) ) &&
+	        !( GetSSYBPack( 0x62, pack62 ) && GetSSYBPack( 0x63, pack63 ) ) )
 		return false;
 
 	int day = pack62.data[ 2 ];
 	int month = pack62.data[ 3 ];
 	int year = pack62.data[ 4 ];
 
-	if ( GetSSYBPack( 0x63, pack63 ) == false )
-		return false;
-
 	int sec = pack63.data[ 2 ];
 	int min = pack63.data[ 3 ];
 	int hour = pack63.data[ 4 ];
@@ -443,7 +423,6 @@ bool DVFrame::GetRecordingDate( struct tm &recDate )
 	if ( mktime( &recDate ) == -1 )
 		return false;
 	return true;
-#endif
 }
 
 
@@ -458,28 +437,16 @@ bool DVFrame::GetRecordingDate( struct tm &recDate )
 
 bool DVFrame::GetTimeCode( TimeCode &timeCode )
 {
-#ifdef HAVE_LIBDV
-	int timestamp[ 4 ];
+	Pack tc;
 
-	if ( dv_get_timestamp_int( decoder, timestamp ) ) {
-		timeCode.hour = timestamp[ 0 ];
-		timeCode.min = timestamp[ 1 ];
-		timeCode.sec = timestamp[ 2 ];
-		timeCode.frame = timestamp[ 3 ];
-		return true;
-	} else {
+	if ( GetSSYBPack( 0x13, tc ) == false )
+	{
 		timeCode.hour = 0;
 		timeCode.min = 0;
 		timeCode.sec = 0;
 		timeCode.frame = 0;
 		return false;
 	}
-#else
-
-	Pack tc;
-
-	if ( GetSSYBPack( 0x13, tc ) == false )
-		return false;
 
 	int frame = tc.data[ 1 ];
 	int sec = tc.data[ 2 ];
@@ -491,7 +458,6 @@ bool DVFrame::GetTimeCode( TimeCode &timeCode )
 	timeCode.min = ( min & 0xf ) + 10 * ( ( min >> 4 ) & 0x7 );
 	timeCode.hour = ( hour & 0xf ) + 10 * ( ( hour >> 4 ) & 0x3 );
 	return true;
-#endif
 }
 
 
@@ -505,6 +471,7 @@ bool DVFrame::GetTimeCode( TimeCode &timeCode )
 bool DVFrame::GetAudioInfo( AudioInfo &info )
 {
 #ifdef HAVE_LIBDV
+	ParseHeader();
 	info.frequency = decoder->audio->frequency;
 	info.samples = decoder->audio->samples_this_frame;
 	info.frames = ( decoder->audio->aaux_as.pc3.system == 1 ) ? 50 : 60;
@@ -613,6 +580,218 @@ int DVFrame::FrameSize( const unsigned char *buf, int len )
 }
 
 
+/** checks whether a buffer starts with a plausible DV frame
+ 
+    Every DIF sequence must start with a header block carrying its own
+    sequence number, followed by subcode, VAUX, audio and video blocks
+    in their fixed places. This does not look at the compressed data,
+    but it is enough to find frame boundaries in a damaged stream.
+ 
+    \param buf the buffer to check
+    \param len the number of valid bytes in buf
+    \return true if buf contains a complete frame with a sane layout */
+
+bool DVFrame::IsValidFrame( const unsigned char *buf, int len )
+{
+	int size = FrameSize( buf, len );
+
+	if ( len < size )
+		return false;
+
+	for ( int i = 0; i < size / 12000; ++i )
+	{
+		const unsigned char *seq = buf + i * 12000;
+
+		if ( ( seq[ 0 ] & 0xe0 ) != 0x00 || ( seq[ 1 ] >> 4 ) != i || ( seq[ 1 ] & 0x07 ) != 0x07 || seq[ 2 ] != 0 )
+			return false;
+		if ( ( seq[ 1 * 80 ] & 0xe0 ) != 0x20 || ( seq[ 3 * 80 ] & 0xe0 ) != 0x40 ||
+		        ( seq[ 6 * 80 ] & 0xe0 ) != 0x60 || ( seq[ 7 * 80 ] & 0xe0 ) != 0x80 )
+			return false;
+	}
+	return true;
+}
+
+
+/** the expected section type and DIF block number of the 150 blocks
+    of a DIF sequence
+ 
+    Block 0 is the header, 1-2 subcode, 3-5 VAUX, and then every 16th
+    block is audio with 15 video blocks in between. */
+
+static struct DIFLayout
+{
+	/// the first ID byte without the arbitrary bits
+	unsigned char id0[ 150 ];
+	/// the DIF block number within its section
+	unsigned char dbn[ 150 ];
+
+	DIFLayout()
+	{
+		for ( int b = 0; b < 150; ++b )
+		{
+			int sct, n;
+
+			if ( b == 0 )
+				sct = 0, n = 0;
+			else if ( b < 3 )
+				sct = 1, n = b - 1;
+			else if ( b < 6 )
+				sct = 2, n = b - 3;
+			else if ( ( b - 6 ) % 16 == 0 )
+				sct = 3, n = ( b - 6 ) / 16;
+			else
+				sct = 4, n = b - 7 - ( b - 6 ) / 16;
+			id0[ b ] = sct << 5;
+			dbn[ b ] = n;
+		}
+	}
+}
+difLayout;
+
+
+/** finds the damaged DIF blocks of the frame
+ 
+    A DIF block counts as damaged if its ID does not match its place
+    in the frame (section type, sequence number, FSC or DIF block
+    number), if a header block disagrees on the video system or the
+    application IDs, if a video block has its error status set by the
+    device that played the tape, or if the content of a video block
+    is all zeros as left behind by lost packets. No video is decoded,
+    so this is cheap enough for every captured frame.
+ 
+    \param map if not NULL, receives DV_DAMAGE_MAP_SIZE bytes with one bit
+           set for each damaged block, counting blocks from the start of
+           the frame and starting with the least significant bit
+    \return the number of damaged DIF blocks */
+
+int DVFrame::GetDamage( unsigned char *map )
+{
+	int seqCount = IsPAL() ? 12 : 10;
+	unsigned char dsf = data[ 3 ] & 0x80;
+	unsigned char apt = data[ 4 ] & 0x07;
+	int damaged = 0;
+
+	if ( map != NULL )
+		memset( map, 0, DV_DAMAGE_MAP_SIZE );
+
+	for ( int i = 0; i < seqCount; ++i )
+	{
+		const unsigned char *seq = data + i * 150 * 80;
+		unsigned char id1 = ( i << 4 ) | 0x07;
+
+		for ( int b = 0; b < 150; ++b )
+		{
+			const unsigned char *p = seq + b * 80;
+			bool bad = ( p[ 0 ] & 0xe0 ) != difLayout.id0[ b ] || p[ 1 ] != id1 || p[ 2 ] != difLayout.dbn[ b ];
+
+			if ( !bad && b == 0 )
+			{
+				bad = ( p[ 3 ] & 0x80 ) != dsf || ( p[ 4 ] & 0x07 ) != apt || ( p[ 5 ] & 0x07 ) != apt ||
+				      ( p[ 6 ] & 0x07 ) != apt || ( p[ 7 ] & 0x07 ) != apt;
+			}
+			else if ( !bad && difLayout.id0[ b ] == 4 << 5 )
+			{
+				/* the loop is kept simple so that the compiler can
+				   vectorize it */
+
+				unsigned char any = 0;
+				for ( int k = 3; k < 80; ++k )
+					any |= p[ k ];
+				bad = ( p[ 3 ] & 0xf0 ) != 0 || any == 0;
+			}
+			if ( bad )
+			{
+				++damaged;
+				if ( map != NULL )
+					map[ ( i * 150 + b ) / 8 ] |= 1 << ( ( i * 150 + b ) % 8 );
+			}
+		}
+	}
+	return damaged;
+}
+
+
+/** Builds a picture from the DC coefficients of the video blocks
+
+    Each 8x8 block of the frame becomes one pixel, so no AC coefficient
+    is decoded and no inverse DCT is done. The chroma of a macroblock
+    is repeated over the pixels of its luma blocks.
+
+    \param yuv DV_DC_WIDTH * DV_DC_HEIGHT pixels of interleaved Y, Cb
+    and Cr in video range, in lines of DV_DC_WIDTH pixels
+    \return the height of the picture, 72 for PAL and 60 for NTSC
+*/
+
+int DVFrame::ExtractDC( unsigned char *yuv )
+{
+	/* the superblock row and column of the 5 macroblocks of a video segment */
+	static const int superRow[ 5 ] = { 2, 6, 8, 0, 4 };
+	static const int superColumn[ 5 ] = { 2, 1, 3, 0, 4 };
+	/* the first macroblock column of each superblock column with 4:1:1 chroma */
+	static const int columnOffset411[ 5 ] = { 0, 4, 9, 13, 18 };
+	/* where the 6 DCT blocks start in a video DIF block: Y0-Y3, Cr, Cb */
+	static const int dctOffset[ 6 ] = { 4, 18, 32, 46, 60, 70 };
+	int seqCount = IsPAL() ? 12 : 10;
+	bool is420 = IsPAL() && ( data[ 4 ] & 0x07 ) == 0;
+
+	for ( int i = 0; i < seqCount; ++i )
+	{
+		for ( int v = 0; v < 135; ++v )
+		{
+			const unsigned char *p = data + ( i * 150 + 7 + ( v / 15 ) * 16 + v % 15 ) * 80;
+			int dc[ 6 ];
+			int k = v / 5;
+			int row = ( i + superRow[ v % 5 ] ) % seqCount;
+			int column = superColumn[ v % 5 ];
+			int x, y, w, h;
+
+			/* the DC coefficient is a signed 9 bit value, half the block average less 128 */
+			for ( int b = 0; b < 6; ++b )
+			{
+				const unsigned char *q = p + dctOffset[ b ];
+				int value = ( q[ 0 ] << 1 ) | ( q[ 1 ] >> 7 );
+				dc[ b ] = ( ( value > 255 ? value - 512 : value ) + 256 ) >> 1;
+			}
+
+			/* find the macroblock, in blocks, as the superblocks zigzag down and up */
+			if ( is420 )
+			{
+				x = ( k / 3 + column * 9 ) * 2;
+				y = ( ( k / 3 ) % 2 == 0 ? k % 3 : 2 - k % 3 ) * 2 + row * 6;
+				w = h = 2;
+			}
+			else
+			{
+				int n = column % 2 ? k + 3 : k;
+				x = ( n / 6 + columnOffset411[ column ] ) * 4;
+				y = ( n / 6 ) % 2 == 0 ? n % 6 : 5 - n % 6;
+				if ( x < 88 )
+				{
+					y += row * 6;
+					w = 4;
+					h = 1;
+				}
+				else
+				{
+					/* the right edge macroblocks are square */
+					y = y * 2 + row * 6;
+					w = h = 2;
+				}
+			}
+
+			for ( int b = 0; b < 4; ++b )
+			{
+				unsigned char *pixel = yuv + ( ( y + b / w ) * DV_DC_WIDTH + x + b % w ) * 3;
+				pixel[ 0 ] = dc[ b ];
+				pixel[ 1 ] = dc[ 5 ];
+				pixel[ 2 ] = dc[ 4 ];
+			}
+		}
+	}
+	return seqCount * 6;
+}
+
+
 /** gets the size of the frame
  
     Depending on the type (PAL or NTSC) of the frame, the length of the frame is returned 
@@ -665,10 +844,6 @@ bool DVFrame::IsPAL( void )
 
 bool DVFrame::IsNewRecording()
 {
-#ifdef HAVE_LIBDV
-	return ( decoder->audio->aaux_asc.pc2.rec_st == 0 );
-#else
-
 	Pack aauxSourceControl;
 
 	/* if we can't find the packet, we return "no new recording" */
@@ -679,7 +854,6 @@ bool DVFrame::IsNewRecording()
 	unsigned char recStartPoint = aauxSourceControl.data[ 2 ] & 0x80;
 
 	return recStartPoint == 0 ? true : false;
-#endif
 }
 
 
@@ -693,26 +867,24 @@ bool DVFrame::IsNewRecording()
 
 bool DVFrame::IsNormalSpeed()
 {
-	bool normal_speed = true;
+	Pack aauxSource;
+	Pack aauxSourceControl;
 
-#ifdef HAVE_LIBDV
-	/* don't do audio if speed is not 1 */
-	if ( decoder->std == e_dv_std_iec_61834 )
-	{
-		normal_speed = ( decoder->audio->aaux_asc.pc3.speed == 0x20 );
-	}
-	else if ( decoder->std == e_dv_std_smpte_314m )
-	{
-		if ( decoder->audio->aaux_as.pc3.system )
-			/* PAL */
-			normal_speed = ( decoder->audio->aaux_asc.pc3.speed == 0x64 );
-		else
-			/* NTSC */
-			normal_speed = ( decoder->audio->aaux_asc.pc3.speed == 0x78 );
-	}
-#endif
+	/* without the packet, assume normal speed */
+
+	if ( GetAAUXPack( 0x51, aauxSourceControl ) == false )
+		return true;
+
+	int speed = aauxSourceControl.data[ 3 ] & 0x7f;
 
-	return ( normal_speed );
+	/* the application ID in the header block tells IEC 61834 (0) from
+	   SMPTE 314M, which codes the speed differently for 50 and 60 Hz */
+
+	if ( ( data[ 4 ] & 0x07 ) == 0 )
+		return speed == 0x20;
+	else if ( GetAAUXPack( 0x50, aauxSource ) )
+		return speed == ( ( aauxSource.data[ 3 ] & 0x20 ) ? 0x64 : 0x78 );
+	return true;
 }
 
 
@@ -741,95 +913,17 @@ int DVFrame::ExtractAudio( void *sound )
 {
 	AudioInfo info;
 
-	if ( GetAudioInfo( info ) == true )
+	if ( GetAudioInfo( info ) == true && ExtractAudio( audio_buffers ) > 0 )
 	{
-#ifdef HAVE_LIBDV
-
-		int n, i;
 		int16_t* s = ( int16_t * ) sound;
 
-		dv_decode_full_audio( decoder, data, ( int16_t ** ) audio_buffers );
-		for ( n = 0; n < info.samples; ++n )
-			for ( i = 0; i < info.channels; i++ )
+		for ( int n = 0; n < info.samples; ++n )
+			for ( int i = 0; i < info.channels; i++ )
 				*s++ = audio_buffers[ i ][ n ];
-
 	}
 	else
 		info.samples = 0;
 
-#else
-		/* Collect the audio samples */
-		char* s = ( char * ) sound;
-
-		switch ( info.frequency )
-		{
-		case 32000:
-
-			/* This is 4 channel audio */
-
-			if ( IsPAL() )
-			{
-				short * p = ( short* ) sound;
-				for ( int n = 0; n < info.samples; ++n )
-				{
-					register int r = ( ( unsigned char* ) data ) [ palmap_2ch1[ n ] + 1 ]; // LSB
-					*p++ = compmap[ ( ( ( unsigned char* ) data ) [ palmap_2ch1[ n ] ] << 4 ) + ( r >> 4 ) ];   // MSB
-					*p++ = compmap[ ( ( ( unsigned char* ) data ) [ palmap_2ch1[ n ] + 1 ] << 4 ) + ( r & 0x0f ) ];
-				}
-
-
-			}
-			else
-			{
-				short* p = ( short* ) sound;
-				for ( int n = 0; n < info.samples; ++n )
-				{
-					register int r = ( ( unsigned char* ) data ) [ ntscmap_2ch1[ n ] + 1 ]; // LSB
-					*p++ = compmap[ ( ( ( unsigned char* ) data ) [ ntscmap_2ch1[ n ] ] << 4 ) + ( r >> 4 ) ];   // MSB
-					*p++ = compmap[ ( ( ( unsigned char* ) data ) [ ntscmap_2ch1[ n ] + 1 ] << 4 ) + ( r & 0x0f ) ];
-				}
-			}
-			break;
-
-		case 44100:
-		case 48000:
-
-			/* this can be optimized significantly */
-
-			if ( IsPAL() )
-			{
-				for ( int n = 0; n < info.samples; ++n )
-				{
-					*s++ = ( ( char* ) data ) [ palmap_ch1[ n ] + 1 ]; /* LSB */
-					*s++ = ( ( char* ) data ) [ palmap_ch1[ n ] ];     /* MSB */
-					*s++ = ( ( char* ) data ) [ palmap_ch2[ n ] + 1 ]; /* LSB */
-					*s++ = ( ( char* ) data ) [ palmap_ch2[ n ] ];     /* MSB */
-				}
-			}
-			else
-			{
-				for ( int n = 0; n < info.samples; ++n )
-				{
-					*s++ = ( ( char* ) data ) [ ntscmap_ch1[ n ] + 1 ]; /* LSB */
-					*s++ = ( ( char* ) data ) [ ntscmap_ch1[ n ] ];     /* MSB */
-					*s++ = ( ( char* ) data ) [ ntscmap_ch2[ n ] + 1 ]; /* LSB */
-					*s++ = ( ( char* ) data ) [ ntscmap_ch2[ n ] ];     /* MSB */
-				}
-			}
-			break;
-
-			/* we can't handle any other format in the moment */
-
-		default:
-			info.samples = 0;
-		}
-
-	}
-	else
-		info.samples = 0;
-
-#endif
-
 	return info.samples * info.channels * 2;
 }
 
@@ -862,14 +956,37 @@ void DVFrame::ExtractHeader( void )
 {
 	dv_parse_header( decoder, data );
 	dv_parse_packs( decoder, data );
+	headerParsed = true;
 }
 
+/** Deinterlaces a decoded frame in place by blending the fields
+
+    Each line becomes a quarter of the lines above and below it and
+    half of itself, so the fields no longer show as combs on motion
+    while still pictures keep most of their vertical detail.
+
+    \param image the decoded frame, GetWidth() pixels per line
+    \param bpp bytes per pixel, at most 4
+*/
+
 void DVFrame::Deinterlace( void * image, int bpp )
 {
 	int width = GetWidth( ) * bpp;
 	int height = GetHeight( );
-	for ( int i = 0; i < height; i += 2 )
-		memcpy( ( uint8_t * ) image + width * ( i + 1 ), ( uint8_t * ) image + width * i, width );
+	uint8_t *line = ( uint8_t * ) image;
+	uint8_t above[ FRAME_MAX_WIDTH * 4 ];
+
+	memcpy( above, line, width );
+	for ( int i = 0; i < height; ++i, line += width )
+	{
+		uint8_t *below = i < height - 1 ? line + width : line;
+		for ( int x = 0; x < width; ++x )
+		{
+			uint8_t current = line[ x ];
+			line[ x ] = ( above[ x ] + 2 * current + below[ x ] + 2 ) >> 2;
+			above[ x ] = current;
+		}
+	}
 }
 
 int DVFrame::ExtractRGB( void * rgb )
@@ -887,13 +1004,26 @@ int DVFrame::ExtractRGB( void * rgb )
 	pitches[ 1 ] = 0;
 	pitches[ 2 ] = 0;
 
+	ParseHeader();
 	dv_decode_full_frame( decoder, data, e_dv_color_rgb, pixels, pitches );
 	return 0;
 }
 
+/** Decodes the frame from its DC coefficients only
+
+    The picture is made of flat 8x8 blocks, but the AC coefficients
+    are not decoded, which makes this much cheaper than ExtractRGB.
+
+    \param rgb a buffer for the picture, 720 pixels of 3 bytes per line
+*/
+
 int DVFrame::ExtractPreviewRGB( void * rgb )
 {
+	int quality = decoder->quality;
+
+	decoder->quality = DV_QUALITY_COLOR | DV_QUALITY_DC;
 	ExtractRGB( rgb );
+	decoder->quality = quality;
 	return 0;
 }
 
@@ -902,6 +1032,7 @@ int DVFrame::ExtractYUV( void * yuv )
 	unsigned char * pixels[ 3 ];
 	int pitches[ 3 ];
 
+	ParseHeader();
 	pixels[ 0 ] = ( unsigned char* ) yuv;
 	pitches[ 0 ] = decoder->width * 2;
 
@@ -909,9 +1040,18 @@ int DVFrame::ExtractYUV( void * yuv )
 	return 0;
 }
 
+/** Decodes the frame from its DC coefficients only, as ExtractPreviewRGB
+
+    \param yuv a buffer for the picture in YUY2, 2 bytes per pixel
+*/
+
 int DVFrame::ExtractPreviewYUV( void * yuv )
 {
+	int quality = decoder->quality;
+
+	decoder->quality = DV_QUALITY_COLOR | DV_QUALITY_DC;
 	ExtractYUV( yuv );
+	decoder->quality = quality;
 	return 0;
 }
 
@@ -924,6 +1064,7 @@ int DVFrame::ExtractPreviewYUV( void * yuv )
 */
 bool DVFrame::IsWide( void )
 {
+	ParseHeader();
 	return dv_format_wide( decoder ) > 0;
 }
 
@@ -934,6 +1075,7 @@ bool DVFrame::IsWide( void )
 */
 int DVFrame::GetWidth()
 {
+	ParseHeader();
 	return decoder->width;
 }
 
@@ -944,6 +1086,7 @@ int DVFrame::GetWidth()
 */
 int DVFrame::GetHeight()
 {
+	ParseHeader();
 	return decoder->height;
 }
 
@@ -966,6 +1109,8 @@ int DVFrame::GetHeight()
 void DVFrame::SetRecordingDate( time_t * datetime, int frame )
 {
 	dv_encode_metadata( data, IsPAL(), IsWide(), datetime, frame );
+	packsIndexed = false;
+	headerParsed = false;
 }
 
 /** Set the TimeCode of the frame.
@@ -978,8 +1123,71 @@ void DVFrame::SetRecordingDate( time_t * datetime, int frame )
 void DVFrame::SetTimeCode( int frame )
 {
 	dv_encode_timecode( data, IsPAL(), frame );
+	packsIndexed = false;
+	headerParsed = false;
 }
 #else
+
+/** retrieves the audio data from the frame
+ 
+    The samples are collected from the audio DIF blocks with the
+    deshuffling tables built by the constructor. 16 bit samples are
+    stored big endian, 12 bit samples are packed three bytes for two
+    channels and expanded to 16 bit through compmap.
+ 
+    \param channels an array of buffers of audio data, one per channel,
+           each holding at least DV_AUDIO_MAX_SAMPLES samples
+    \return the number of bytes put into the buffers, or 0 if no audio data could be retrieved */
+
+int DVFrame::ExtractAudio( int16_t **channels )
+{
+	AudioInfo info;
+
+	if ( GetAudioInfo( info ) == false )
+		return 0;
+
+	const unsigned char *d = data;
+	int16_t *left = channels[ 0 ];
+	int16_t *right = channels[ 1 ];
+
+	switch ( info.frequency )
+	{
+	case 32000:
+		{
+			const int *map = IsPAL() ? palmap_2ch1 : ntscmap_2ch1;
+
+			for ( int n = 0; n < info.samples; ++n )
+			{
+				const unsigned char *p = d + map[ n ];
+				left[ n ] = compmap[ ( p[ 0 ] << 4 ) | ( p[ 2 ] >> 4 ) ];
+				right[ n ] = compmap[ ( p[ 1 ] << 4 ) | ( p[ 2 ] & 0x0f ) ];
+			}
+		}
+		break;
+
+	case 44100:
+	case 48000:
+		{
+			const int *map1 = IsPAL() ? palmap_ch1 : ntscmap_ch1;
+			const int *map2 = IsPAL() ? palmap_ch2 : ntscmap_ch2;
+
+			for ( int n = 0; n < info.samples; ++n )
+			{
+				left[ n ] = ( int16_t ) ( ( d[ map1[ n ] ] << 8 ) | d[ map1[ n ] + 1 ] );
+				right[ n ] = ( int16_t ) ( ( d[ map2[ n ] ] << 8 ) | d[ map2[ n ] + 1 ] );
+			}
+		}
+		break;
+
+		/* we can't handle any other format in the moment */
+
+	default:
+		info.samples = 0;
+	}
+
+	return info.samples * info.channels * 2;
+}
+
 void DVFrame::ExtractHeader( void )
 {}
 #endif
@@ -36,6 +36,13 @@
 #define FRAME_MAX_WIDTH 720
 #define FRAME_MAX_HEIGHT 576
 
+/// the size of a picture made from DC coefficients, one pixel for each 8x8 block
+#define DV_DC_WIDTH ( FRAME_MAX_WIDTH / 8 )
+#define DV_DC_HEIGHT ( FRAME_MAX_HEIGHT / 8 )
+
+/// bytes in a damage map, one bit for each of the 1800 DIF blocks of a PAL frame
+#define DV_DAMAGE_MAP_SIZE ( 12 * 150 / 8 )
+
 typedef struct Pack
 {
 	/// the five bytes of a packet
@@ -82,6 +89,7 @@ public:
 	~DVFrame();
 
 	void SetDataLen( int len );
+	void Clear( void );
 
 	// Meta-data
 	bool GetTimeCode( TimeCode &timeCode );
@@ -97,23 +105,22 @@ public:
 #endif
 	float GetFrameRate();
 
-	// HDV cd DV
-	bool IsHDV();
-
-
 	bool GetSSYBPack( int packNum, Pack &pack );
 	bool GetVAUXPack( int packNum, Pack &pack );
 	bool GetAAUXPack( int packNum, Pack &pack );
 	bool GetAudioInfo( AudioInfo &info );
 	bool GetVideoInfo( VideoInfo &info );
 	static int FrameSize( const unsigned char *buf, int len );
+	static bool IsValidFrame( const unsigned char *buf, int len );
+	int GetDamage( unsigned char *map = NULL );
+	int ExtractDC( unsigned char *yuv );
 	int GetExpectedSize( void );
 	bool IsPAL( void );
 	int ExtractAudio( void *sound );
+	int ExtractAudio( int16_t **channels );
 	void ExtractHeader( void );
 
 #ifdef HAVE_LIBDV
-	int ExtractAudio( int16_t **channels );
 	int ExtractRGB( void *rgb );
 	int ExtractPreviewRGB( void *rgb );
 	int ExtractYUV( void *yuv );
@@ -125,6 +132,20 @@ public:
 #endif
 
 private:
+	void IndexPacks( void );
+	bool FindPack( const int *index, int packNum, Pack &pack );
+	void ParseHeader( void );
+
+	/// true if ExtractHeader has run on the current data
+	bool headerParsed;
+
+	/// true if the pack tables below describe the current data
+	bool packsIndexed;
+	/// offsets of the first SSYB, VAUX and AAUX pack of each id in data, 0 if absent
+	int ssybPacks[ 256 ];
+	int vauxPacks[ 256 ];
+	int aauxPacks[ 256 ];
+
 #ifndef HAVE_LIBDV
 	/// flag for initializing the lookup maps once at startup
 	static bool maps_initialized;
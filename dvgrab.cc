@@ -38,6 +38,7 @@ using std::endl;
 #include <time.h>
 #include <string.h>
 #include <sys/select.h>
+#include <sys/stat.h>
 #include <libavc1394/avc1394.h>
 #include <libavc1394/avc1394_vcr.h>
 #include <libavc1394/rom1394.h>
@@ -51,6 +52,7 @@ using std::endl;
 #include "stringutils.h"
 #include "v4l2reader.h"
 #include "srt.h"
+#include "damage.h"
 
 extern bool g_done;
 pthread_mutex_t DVgrab::capture_mutex;
@@ -59,6 +61,7 @@ pthread_t DVgrab::watchdog_thread;
 Frame *DVgrab::m_frame;
 FileHandler *DVgrab::m_writer;
 static SubtitleWriter subWriter;
+static DamageWriter damageWriter;
 
 
 DVgrab::DVgrab( int argc, char *argv[] ) :
@@ -66,9 +69,12 @@ DVgrab::DVgrab( int argc, char *argv[] ) :
 		m_timestamp( false ), m_channel( DEFAULT_CHANNEL ), m_frame_count( DEFAULT_FRAMES ),
 		m_max_file_size( DEFAULT_SIZE ), m_collection_size( DEFAULT_CSIZE ),
 		m_collection_min_cut_file_size( DEFAULT_CMINCUTSIZE ), m_sizesplitmode ( 0 ),
-		m_file_format( DEFAULT_FORMAT ), m_open_dml( false ), m_frame_every( DEFAULT_EVERY ),
+		m_file_format( DEFAULT_FORMAT ), m_open_dml( false ), m_checkpoint( DEFAULT_CHECKPOINT ),
+		m_frame_every( DEFAULT_EVERY ),
 		m_jpeg_quality( 75 ), m_jpeg_deinterlace( false ), m_jpeg_width( -1 ), m_jpeg_height( -1 ),
 		m_jpeg_overwrite( false ), m_jpeg_temp( "dvtmp.jpg" ), m_jpeg_usetemp( false ),
+		m_jpeg_threads( sysconf( _SC_NPROCESSORS_ONLN ) ), m_jpeg_preview( false ),
+		m_thumb_every( 0 ), m_thumb_columns( 8 ), m_thumb_rows( 8 ),
 		m_dropped_frames( 0 ), m_bad_frames(0), m_interactive( false ), m_buffers( DEFAULT_BUFFERS ), m_total_frames( 0 ),
 		m_duration( "" ), m_timeDuration( 0 ), m_noavc( false ),
 		m_guid( 0 ), m_timesys( false ), m_connection( 0 ), m_raw_pipe( false ),
@@ -77,7 +83,7 @@ DVgrab::DVgrab( int argc, char *argv[] ) :
 		m_captureActive( false ), m_avc( 0 ), m_reader( 0 ), m_hdv( false ), m_showstatus( false ),
 		m_isLastTimeCodeSet( false ), m_isLastRecDateSet( false ), m_v4l2( false ), m_jvc_p25( false ),
 		m_24p( false ), m_24pa( false ), m_isRecordMode( false ), m_isRewindFirst( false ),
-		m_timeSplit(0), m_srt( false ), m_isNewFile(false)
+		m_timeSplit(0), m_sceneSplit( 0 ), m_srt( false ), m_damage( false ), m_gopIndex( false ), m_mp2( false ), m_noNull( false ), m_isNewFile(false)
 {
 	m_frame = 0;
 	m_writer = 0;
@@ -103,7 +109,7 @@ DVgrab::DVgrab( int argc, char *argv[] ) :
 		if ( ( m_interactive || ! m_input_file_name ) && ( ! m_noavc && m_node == -1 ) )
 			throw std::string( "no camera exists" );
 	
-		if ( m_file_format == MPEG2TS_FORMAT )
+		if ( m_file_format == MPEG2TS_FORMAT || m_file_format == MP4_FORMAT )
 			m_hdv = true;
 	}
 
@@ -121,7 +127,8 @@ DVgrab::DVgrab( int argc, char *argv[] ) :
 				m_avc->Pause( m_node );
 			if ( m_avc->isHDV( m_node ) )
 			{
-				m_file_format = MPEG2TS_FORMAT;
+				if ( m_file_format != MP4_FORMAT )
+					m_file_format = MPEG2TS_FORMAT;
 				m_hdv = true;
 			}
 		}
@@ -145,7 +152,13 @@ DVgrab::DVgrab( int argc, char *argv[] ) :
 	}
 	else if ( m_input_file_name )
 	{
-		m_reader = new pipeReader( m_input_file_name, m_buffers, m_hdv );
+		struct stat st;
+
+		// Remux DV files instead of streaming them through a pipe
+		if ( !m_hdv && strcmp( m_input_file_name, "-" ) && stat( m_input_file_name, &st ) == 0 && S_ISREG( st.st_mode ) )
+			m_reader = new fileReader( m_input_file_name, m_buffers );
+		else
+			m_reader = new pipeReader( m_input_file_name, m_buffers, m_hdv );
 	}
 	else
 		throw std::string( "invalid source specified" );
@@ -184,9 +197,12 @@ void DVgrab::print_help()
 	cerr << "  -buffers number      the number of internal frames to buffer [default " << DEFAULT_BUFFERS << "]" << endl;
 	cerr << "  -card number         card number [default automatic]" << endl;
 	cerr << "  -channel number      iso channel number for listening [default " << DEFAULT_CHANNEL << "]" << endl;
+	cerr << "  -checkpoint secs     update AVI headers and indexes every secs seconds" << endl;
+	cerr << "                          0 = only on close [default " << DEFAULT_CHECKPOINT << "]" << endl;
 	cerr << "  -cmincutsize num     min file size in MiB due to collection split [default " << DEFAULT_CMINCUTSIZE << "]" << endl;
 	cerr << "  -csize number        split file when collections of files are about to exceed" << endl;
 	cerr << "                          number MiB, 0 = unlimited [default " << DEFAULT_CSIZE << "]" << endl;
+	cerr << "  -damage              log frames with damaged DIF blocks next to DV files" << endl;
 	cerr << "  -debug type          display (HDV) debug info, type is one or more of:" << endl;
 	cerr << "                          all,pat,pmt,pids,pid=N,pes,packet,video,sonya1" << endl;
 	cerr << "  -d, -duration time   total capture duration specified as a SMIL time value:" << endl;
@@ -203,22 +219,29 @@ void DVgrab::print_help()
 	cerr << "              qt, mov     QuickTime DV movie" << endl;
 #endif
 	cerr << "              mpeg2, hdv  MPEG-2 transport stream (HDV)" << endl;
+	cerr << "              mp4         fragmented MP4 file (HDV)" << endl;
 #if defined(HAVE_LIBJPEG) && defined(HAVE_LIBDV)
 	cerr << "              jpeg, jpg   sequence of JPEG files (DV only)" << endl;
+#endif
+#ifdef HAVE_LIBJPEG
+	cerr << "              thumbs      JPEG contact sheets of DV thumbnails" << endl;
 #endif
 	cerr << "  -F, -frames number   max number of frames per split" << endl;
 	cerr << "                          0 = unlimited [default " << DEFAULT_FRAMES << "]" << endl;
+	cerr << "  -gopindex            write an index of the GOPs next to HDV files" << endl;
 	cerr << "  -guid hex            select one of multiple DV devices by its GUID" << endl;
 	cerr << "                          GUID is in hexadecimal; see /sys/bus/ieee1394/devices/" << endl;
 	cerr << "  -h, -help            display this help and exit" << endl;
 	cerr << "  -I, -input file       read from file (\"-\" = stdin)" << endl;
 	cerr << "  -i, -interactive     go interactive with camera VTR and capture control" << endl;
 #if defined(HAVE_LIBJPEG) && defined(HAVE_LIBDV)
-	cerr << "  -jpeg-deinterlace    deinterlace the output by line doubling the upper field" << endl;
+	cerr << "  -jpeg-deinterlace    deinterlace the output by blending the fields" << endl;
 	cerr << "  -jpeg-height n       scale the output to the specified height (max=2048)" << endl;
 	cerr << "  -jpeg-overwrite      overwrite the same file instead of creating a sequence" << endl;
+	cerr << "  -jpeg-preview        decode only the DC coefficients, for fast low quality stills" << endl;
 	cerr << "  -jpeg-quality n      set the JPEG compression level" << endl;
 	cerr << "  -jpeg-temp name      use name as temporary file output" << endl;
+	cerr << "  -jpeg-threads n      encode JPEG files with n threads (default = processors)" << endl;
 	cerr << "  -jpeg-width n        scale the output to the specified width (max=2048)" << endl;
 #endif
 	cerr << "  -jvc-p25             remove repeat_first_field flag and set fps to 25 (HDV)" << endl;
@@ -228,16 +251,28 @@ void DVgrab::print_help()
 	cerr << "                          -1 = unlimited [default " << DEFAULT_LOCKSTEP_MAXDROPS << "]" << endl;
 	cerr << "  -lockstep_totaldrops max total frame drops before closing file" << endl;
 	cerr << "                          -1 = unlimited [default " << DEFAULT_LOCKSTEP_TOTALDROPS << "]" << endl;
+	cerr << "  -mp2                 write the audio of HDV files to .mp2 files next to them" << endl;
 	cerr << "  -noavc               disable use of AV/C VTR control" << endl;
+	cerr << "  -nonull              do not write the null packets of HDV" << endl;
 	cerr << "  -nostop              do not send AV/C stop command on exit" << endl;
 	cerr << "  -opendml             use the OpenDML extensions to write large (>1GB)" << endl;
 	cerr << "                          'Type 2' DV AVI files (requires -format dv2)" << endl;
+	cerr << "  -pids list           only write these PIDs of HDV, a comma separated list of" << endl;
+	cerr << "                          numbers, video and audio; PAT, PMT and PCR are kept" << endl;
 	cerr << "  -r, recordonly       only capture when not paused while in record mode" << endl;
 	cerr << "  -rewind              completely rewind the tape prior to capture" << endl;
+	cerr << "  -scenesplit n        start a new file at a cut found in the picture content," << endl;
+	cerr << "                          n is the picture change in percent, 0 = off [default 0]" << endl;
 	cerr << "  -showstatus          show the recording status while capturing" << endl;
 	cerr << "  -s, -size number     max file size, 0 = unlimited [default " << DEFAULT_SIZE << "]" << endl;
 	cerr << "  -srt                 write SRT files with the recording date\n";
 	cerr << "  -stdin               read from stdin pipe [default = raw1394]" << endl;
+#ifdef HAVE_LIBJPEG
+	cerr << "  -thumb-columns n     thumbnails per line of a contact sheet [default 8]" << endl;
+	cerr << "  -thumb-every n       take a thumbnail every n frames, 0 = only at the start" << endl;
+	cerr << "                          of each recording [default 0]" << endl;
+	cerr << "  -thumb-rows n        lines of thumbnails per contact sheet [default 8]" << endl;
+#endif
 	cerr << "  -timecode            put the first frame's timecode into the file name" << endl;
 	cerr << "  -t, -timestamp       put the date and time of recording into the file name" << endl;
 	cerr << "  -timesys             put the system date and time into the file name" << endl;
@@ -269,9 +304,15 @@ void DVgrab::set_file_format( char *format )
 #if defined(HAVE_LIBJPEG) && defined(HAVE_LIBDV)
 	else if ( strcmp( "jpeg", format ) == 0 || strcmp( "jpg", format ) == 0 )
 		m_file_format = JPEG_FORMAT;
+#endif
+#ifdef HAVE_LIBJPEG
+	else if ( strcmp( "thumbs", format ) == 0 )
+		m_file_format = THUMB_FORMAT;
 #endif
 	else if ( strncmp( "mpeg2", format, 5 ) == 0 || strcmp( "hdv", format ) == 0 )
 		m_file_format = MPEG2TS_FORMAT;
+	else if ( strcmp( "mp4", format ) == 0 )
+		m_file_format = MP4_FORMAT;
 	else
 	{
 		cerr << "Unknown file format : " << format << endl;
@@ -299,6 +340,8 @@ void DVgrab::set_format_from_name( void )
 			m_file_format = JPEG_FORMAT;
 		else if ( ext == "M2T" )
 			m_file_format = MPEG2TS_FORMAT;
+		else if ( ext == "MP4" )
+			m_file_format = MP4_FORMAT;
 		else
 		{
 			cerr << "Unknown filename extension" << endl;
@@ -321,13 +364,16 @@ void DVgrab::getargs( int argc, char *argv[] )
 		{ "buffers", required_argument, &m_buffers, 0xff },
 		{ "card", required_argument, &m_port, 0xff },
 		{ "channel", required_argument, &m_channel, 0xff },
+		{ "checkpoint", required_argument, &m_checkpoint, 0xff },
 		{ "cmincutsize", required_argument, &m_collection_min_cut_file_size, 0xff },
 		{ "csize", required_argument, &m_collection_size, 0xff },
+		{ "damage", no_argument, &m_damage, true },
 		{ "debug", required_argument, 0, 0 },
 		{ "duration", required_argument, 0, 0 },
 		{ "every", required_argument, &m_frame_every, 0xff },
 		{ "format", required_argument, 0, 'f' },
 		{ "frames", required_argument, &m_frame_count, 0xff },
+		{ "gopindex", no_argument, &m_gopIndex, true },
 		{ "guid", required_argument, 0, 0 },
 		{ "help", no_argument, 0, 'h' },
 		{ "input", required_argument, 0, 'I' },
@@ -336,23 +382,34 @@ void DVgrab::getargs( int argc, char *argv[] )
 		{ "jpeg-deinterlace", no_argument, &m_jpeg_deinterlace, true },
 		{ "jpeg-height", required_argument, &m_jpeg_height, 0xff },
 		{ "jpeg-overwrite", no_argument, &m_jpeg_overwrite, true },
+		{ "jpeg-preview", no_argument, &m_jpeg_preview, true },
 		{ "jpeg-quality", required_argument, &m_jpeg_quality, 0xff },
 		{ "jpeg-temp", required_argument, &m_jpeg_usetemp, true },
+		{ "jpeg-threads", required_argument, &m_jpeg_threads, 0xff },
 		{ "jpeg-width", required_argument, &m_jpeg_width, 0xff },
 #endif
 		{ "jvc-p25", no_argument, &m_jvc_p25, true },
 		{ "lockstep", no_argument, &m_lockstep, true },
 		{ "lockstep_maxdrops", required_argument, &m_lockstep_maxdrops, 0xff },
 		{ "lockstep_totaldrops", required_argument, &m_lockstep_totaldrops, 0xff },
+		{ "mp2", no_argument, &m_mp2, true },
 		{ "noavc", no_argument, &m_noavc, true },
+		{ "nonull", no_argument, &m_noNull, true },
 		{ "nostop", no_argument, &m_no_stop, true },
 		{ "opendml", no_argument, &m_open_dml, true },
+		{ "pids", required_argument, 0, 0 },
 		{ "recordonly", no_argument, 0, 'r'},
 		{ "rewind", no_argument, &m_isRewindFirst, true },
+		{ "scenesplit", required_argument, &m_sceneSplit, 0xff },
 		{ "showstatus", no_argument, &m_showstatus, true },
 		{ "size", required_argument, &m_max_file_size, 0xff },
 		{ "srt", no_argument, &m_srt, true },
 		{ "stdin", no_argument, 0, 0 },
+#ifdef HAVE_LIBJPEG
+		{ "thumb-columns", required_argument, &m_thumb_columns, 0xff },
+		{ "thumb-every", required_argument, &m_thumb_every, 0xff },
+		{ "thumb-rows", required_argument, &m_thumb_rows, 0xff },
+#endif
 		{ "timecode", no_argument, &m_timecode, true },
 		{ "timestamp", no_argument, &m_timestamp, true },
 		{ "timesys", no_argument, &m_timesys, true },
@@ -427,6 +484,30 @@ void DVgrab::getargs( int argc, char *argv[] )
 				}
 				else if ( strcmp( "jpeg-temp", name ) == 0 )
 					m_jpeg_temp = optarg;
+				else if ( strcmp( "pids", name ) == 0 )
+				{
+					char *str = strdup( optarg );
+					char *list = str;
+					char *token;
+					while ( ( token = strsep( &list, "," ) ) )
+					{
+						char *end;
+						long pid = strtol( token, &end, 0 );
+						if ( strcmp( token, "video" ) == 0 )
+							m_pidFilter.KeepVideo();
+						else if ( strcmp( token, "audio" ) == 0 )
+							m_pidFilter.KeepAudio();
+						else if ( *token && !*end && pid >= 0 && pid < 0x1fff )
+							m_pidFilter.Keep( pid );
+						else
+						{
+							cerr << "Invalid PID : " << token << endl;
+							print_usage();
+							exit( EXIT_FAILURE );
+						}
+					}
+					free( str );
+				}
 				else if ( strcmp( "stdin", name ) == 0 )
 					m_input_file_name = "-";
 				else if ( strcmp( "duration", name ) == 0 )
@@ -531,6 +612,7 @@ void DVgrab::startCapture()
 			{
 				AVIHandler *aviWriter = new AVIHandler( AVI_DV1_FORMAT );
 				m_writer = aviWriter;
+				aviWriter->SetCheckpoint( m_checkpoint );
 				break;
 			}
 
@@ -544,6 +626,7 @@ void DVgrab::startCapture()
 					m_open_dml = true;
 				}
 				aviWriter->SetOpenDML( m_open_dml );
+				aviWriter->SetCheckpoint( m_checkpoint );
 				break;
 			}
 
@@ -557,12 +640,28 @@ void DVgrab::startCapture()
 
 #if defined(HAVE_LIBJPEG) && defined(HAVE_LIBDV)
 		case JPEG_FORMAT:
-			m_writer = new JPEGHandler( m_jpeg_quality, m_jpeg_deinterlace, m_jpeg_width, m_jpeg_height, m_jpeg_overwrite, m_jpeg_temp, m_jpeg_usetemp );
+			m_writer = new JPEGHandler( m_jpeg_quality, m_jpeg_deinterlace, m_jpeg_width, m_jpeg_height, m_jpeg_overwrite, m_jpeg_temp, m_jpeg_usetemp, m_jpeg_threads, m_jpeg_preview );
+			break;
+#endif
+
+#ifdef HAVE_LIBJPEG
+		case THUMB_FORMAT:
+			m_writer = new ThumbHandler( m_jpeg_quality, m_thumb_every, m_thumb_columns, m_thumb_rows );
 			break;
 #endif
 
 		case MPEG2TS_FORMAT:
-			m_writer = new Mpeg2Handler( m_jvc_p25 ? MPEG2_JVC_P25 : 0 );
+			{
+				Mpeg2Handler *handler = new Mpeg2Handler( ( m_jvc_p25 ? MPEG2_JVC_P25 : 0 ) | ( m_gopIndex ? MPEG2_GOP_INDEX : 0 ) |
+				                                          ( m_mp2 ? MPEG2_AUDIO : 0 ) );
+				m_pidFilter.SetDropNull( m_noNull );
+				handler->SetPIDFilter( m_pidFilter );
+				m_writer = handler;
+			}
+			break;
+
+		case MP4_FORMAT:
+			m_writer = new Mp4Handler();
 			break;
 
 		}
@@ -573,6 +672,7 @@ void DVgrab::startCapture()
 		m_writer->SetMaxFrameCount( m_frame_count );
 		m_writer->SetAutoSplit( m_autosplit );
 		m_writer->SetTimeSplit ( m_timeSplit );
+		m_writer->SetSceneSplit( m_sceneSplit );
 		m_writer->SetEveryNthFrame( m_frame_every );
 		m_writer->SetMaxFileSize( ( off_t ) m_max_file_size * ( off_t ) ( 1024 * 1024 ) );
 		if (m_collection_size) {
@@ -889,6 +989,12 @@ void DVgrab::writeFrame()
 
 		m_isNewFile |= m_writer->IsNewFile();
 
+		// With -every, the writer skips most frames
+		bool isWritten = m_writer->IsNewFile() || m_writer->GetFramesWritten() != framesWritten;
+		if ( m_damage && !m_hdv && isWritten )
+			damageWriter.addFrame( m_writer->GetFileName().c_str(), m_writer->GetFramesWritten() - 1,
+				*static_cast<DVFrame*>( m_frame ) );
+
 		if ( m_writer->IsNewFile() && !m_writer->IsFirstFile() )
 		{
 			sendCaptureStatus( fileName.c_str(), size, framesWritten, lasttc, lastrd, true );
@@ -1071,6 +1177,16 @@ void DVgrab::captureThreadRun()
 				FD_SET( fileno( stdout ), &wfds );
 				if ( select( fileno( stdout ) + 1, NULL, &wfds, NULL, &tv ) )
 				{
+					if ( m_hdv )
+					{
+						HDVFrame *hdvframe = static_cast<HDVFrame*>( m_frame );
+						for ( int i = 0; i < hdvframe->GetHeadCount(); i++ )
+						{
+							int length;
+							unsigned char *head = hdvframe->GetHead( i, length );
+							write( fileno( stdout ), head, length );
+						}
+					}
 					write( fileno( stdout ), m_frame->data, m_frame->GetDataLen() );
 				}
 			}
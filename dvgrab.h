@@ -46,6 +46,7 @@
 #define DEFAULT_CMINCUTSIZE 0
 #define DEFAULT_EVERY 1
 #define DEFAULT_CHANNEL 63
+#define DEFAULT_CHECKPOINT 10
 #define DEFAULT_BUFFERS 100
 #define DEFAULT_V4L2_DEVICE "/dev/video"
 
@@ -75,6 +76,7 @@ private:
 	int m_sizesplitmode;
 	int m_file_format;
 	int m_open_dml;
+	int m_checkpoint;
 	int m_frame_every;
 	int m_jpeg_quality;
 	int m_jpeg_deinterlace;
@@ -83,6 +85,11 @@ private:
 	std::string m_jpeg_temp;
 	int m_jpeg_usetemp;
 	int m_jpeg_overwrite;
+	int m_jpeg_threads;
+	int m_jpeg_preview;
+	int m_thumb_every;
+	int m_thumb_columns;
+	int m_thumb_rows;
 	int m_dropped_frames;
 	int m_bad_frames;
 	bool m_interactive;
@@ -110,7 +117,13 @@ private:
 	int m_24p;
 	int m_24pa;
 	int m_timeSplit;
+	int m_sceneSplit;
 	int m_srt;
+	int m_damage;
+	int m_gopIndex;
+	int m_mp2;
+	PIDFilter m_pidFilter;
+	int m_noNull;
 	bool m_isNewFile;
 	bool m_isRecordMode;
 	int m_isRewindFirst;
@@ -0,0 +1,362 @@
+/*
+* dvrecover.cc -- recover interrupted DV captures
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/** Recovers DV files whose capture was interrupted
+
+    An AVI file which was not closed properly lacks its headers and
+    indexes. dvgrab writes AVI files in a deterministic layout, so the
+    frames found on disk are run through the same AVI writer again,
+    which reproduces the lost directory. Only the headers and indexes
+    are written, the frame data stays where it is.
+
+    A raw DV file is copied frame by frame to a new file. Damaged data
+    between frames is skipped by searching for the next DIF header.
+
+    \file dvrecover.cc
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string>
+#include <iostream>
+
+using std::string;
+using std::cerr;
+using std::endl;
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "error.h"
+#include "riff.h"
+#include "avi.h"
+#include "dvframe.h"
+
+#define RAW_BUFFER_SIZE ( 32 * 144000 )
+
+/// what an interrupted capture may leave after the last complete frame:
+/// a partial frame with its audio, new standard indexes and a checkpoint idx1
+#define MAX_TRAILING_SIZE ( 2 * ( RIFF_HEADERSIZE + 144000 + ( off_t ) sizeof( AVIStdIndex ) ) + \
+	RIFF_HEADERSIZE + ( off_t ) sizeof( AVISimpleIndex ) )
+
+typedef struct
+{
+	FOURCC type;
+	DWORD length;
+}
+PACKED(ChunkHeader);
+
+
+/** An AVI file being rebuilt in place
+
+    The frame data chunks are already on disk, so they are not written
+    again. Everything else goes to the file as usual.
+*/
+
+template < class T > class RecoveryFile : public T
+{
+public:
+	RecoveryFile( const char *filename )
+	{
+		fail_neg( this->fd = open( filename, O_RDWR ) );
+	}
+
+	void WriteChunk( int chunk_index, const void *data )
+	{
+		FOURCC type = this->GetDirectoryEntry( chunk_index ).type;
+
+		if ( type != make_fourcc( "00__" ) && type != make_fourcc( "00dc" ) && type != make_fourcc( "01wb" ) )
+			T::WriteChunk( chunk_index, data );
+	}
+};
+
+
+/** Reads the DV frame at a movi list position
+
+    \param fd the AVI file
+    \param offset the file offset of the first chunk of the frame
+    \param frame the frame to fill
+    \param audioSize set to the size of the audio chunk preceding the video, 0 if none
+    \return true if a complete and sane frame was found at offset
+*/
+
+static bool ReadAVIFrame( int fd, off_t offset, DVFrame &frame, int &audioSize )
+{
+	ChunkHeader header;
+
+	audioSize = 0;
+	if ( pread( fd, &header, sizeof( header ), offset ) != sizeof( header ) )
+		return false;
+	if ( header.type == make_fourcc( "01wb" ) )
+	{
+		audioSize = header.length;
+		offset += RIFF_HEADERSIZE + audioSize;
+		if ( pread( fd, &header, sizeof( header ), offset ) != sizeof( header ) )
+			return false;
+	}
+	if ( header.type != make_fourcc( "00__" ) && header.type != make_fourcc( "00dc" ) )
+		return false;
+	if ( header.length != 120000 && header.length != 144000 )
+		return false;
+	if ( pread( fd, frame.data, header.length, offset + RIFF_HEADERSIZE ) != header.length )
+		return false;
+	if ( !DVFrame::IsValidFrame( frame.data, header.length ) )
+		return false;
+	frame.SetDataLen( header.length );
+	return true;
+}
+
+
+static AVIFile *NewRecoveryFile( bool type2, const char *filename )
+{
+	if ( type2 )
+		return new RecoveryFile< AVI2File >( filename );
+	else
+		return new RecoveryFile< AVI1File >( filename );
+}
+
+
+/** Rebuilds the headers and indexes of an AVI file written by dvgrab
+
+    \param filename the file to repair in place
+    \param force truncate the file even if data follows the last readable frame
+    \return an exit status
+*/
+
+static int RecoverAVI( const char *filename, bool force )
+{
+	static const struct
+	{
+		bool type2;
+		int indexType;
+	}
+	layouts[] =
+	    {
+	        { false, AVI_SMALL_INDEX | AVI_LARGE_INDEX },
+	        { true, AVI_SMALL_INDEX | AVI_LARGE_INDEX },
+	        { true, AVI_SMALL_INDEX }
+	    };
+	DVFrame frame;
+	AudioInfo audioInfo;
+	VideoInfo videoInfo;
+	char soundbuf[ 20000 ];
+	int audioSize;
+	int layout = -1;
+	int frames = 0;
+	int fd;
+	struct stat st;
+	AVIFile *avi;
+
+	fail_neg( fd = open( filename, O_RDONLY ) );
+	fail_neg( fstat( fd, &st ) );
+
+	/* The headers may be missing entirely, so find out which layout
+	   puts the first frame where it actually is. The size of the
+	   headers does not depend on the video system. */
+
+	for ( int i = 0; layout == -1 && i < ( int ) ( sizeof( layouts ) / sizeof( layouts[ 0 ] ) ); ++i )
+	{
+		avi = NewRecoveryFile( layouts[ i ].type2, filename );
+		avi->Init( AVI_PAL, 48000, layouts[ i ].indexType );
+		if ( ReadAVIFrame( fd, avi->GetNextChunkOffset(), frame, audioSize ) &&
+		        ( audioSize > 0 ) == layouts[ i ].type2 )
+			layout = i;
+		delete avi;
+	}
+	if ( layout == -1 )
+	{
+		cerr << filename << ": no DV frame found where dvgrab puts the first one" << endl;
+		close( fd );
+		return EXIT_FAILURE;
+	}
+
+	frame.GetAudioInfo( audioInfo );
+	frame.GetVideoInfo( videoInfo );
+	avi = NewRecoveryFile( layouts[ layout ].type2, filename );
+	avi->Init( videoInfo.isPAL ? AVI_PAL : AVI_NTSC, audioInfo.frequency, layouts[ layout ].indexType );
+
+	/* Replay the frames as long as they are where the writer expects
+	   them. For type 2 files the replayed audio chunk must also match
+	   the one on disk. */
+
+	off_t offset = avi->GetNextChunkOffset();
+	while ( ReadAVIFrame( fd, offset, frame, audioSize ) )
+	{
+		if ( layouts[ layout ].type2 && frame.ExtractAudio( soundbuf ) != audioSize )
+			break;
+		if ( !avi->WriteFrame( &frame ) )
+			break;
+		++frames;
+		offset = avi->GetNextChunkOffset();
+	}
+	close( fd );
+
+	if ( st.st_size - offset > MAX_TRAILING_SIZE && !force )
+	{
+		cerr << filename << ": unreadable frame at offset " << offset << " followed by "
+		<< st.st_size - offset << " bytes, not truncating (use -force)" << endl;
+		delete avi;
+		return EXIT_FAILURE;
+	}
+
+	avi->WriteRIFF();
+	off_t size = avi->GetFileSize();
+	delete avi;
+	fail_neg( truncate( filename, size ) );
+
+	cerr << filename << ": recovered " << frames << " frames, "
+	<< ( layouts[ layout ].type2 ? "type 2" : "type 1" )
+	<< ( ( layouts[ layout ].indexType & AVI_LARGE_INDEX ) ? " OpenDML" : "" ) << " AVI" << endl;
+	return EXIT_SUCCESS;
+}
+
+
+/** Copies the intact frames of a raw DV file
+
+    \param input the damaged file
+    \param output the file to create
+    \return an exit status
+*/
+
+static int RecoverRaw( const char *input, const char *output )
+{
+	unsigned char *buffer = new unsigned char[ RAW_BUFFER_SIZE ];
+	int in;
+	int out;
+	int start = 0;
+	int end = 0;
+	bool eof = false;
+	int frames = 0;
+	off_t skipped = 0;
+
+	fail_neg( in = open( input, O_RDONLY ) );
+	fail_neg( out = open( output, O_WRONLY | O_CREAT | O_TRUNC, 00644 ) );
+
+	while ( true )
+	{
+		/* keep at least one complete frame in the buffer */
+
+		if ( end - start < 144000 && !eof )
+		{
+			memmove( buffer, buffer + start, end - start );
+			end -= start;
+			start = 0;
+			while ( end < RAW_BUFFER_SIZE && !eof )
+			{
+				ssize_t n;
+				fail_neg( n = read( in, buffer + end, RAW_BUFFER_SIZE - end ) );
+				if ( n == 0 )
+					eof = true;
+				end += n;
+			}
+		}
+		if ( end - start < 120000 )
+			break;
+
+		int size = DVFrame::FrameSize( buffer + start, end - start );
+		if ( DVFrame::IsValidFrame( buffer + start, end - start ) )
+		{
+			for ( int n = 0; n < size; )
+			{
+				ssize_t written;
+				fail_neg( written = write( out, buffer + start + n, size - n ) );
+				n += written;
+			}
+			start += size;
+			++frames;
+			continue;
+		}
+
+		/* Lost sync: the next frame starts with a header block of DIF
+		   sequence 0, whose second byte is 0x07. */
+
+		int next = start + 1;
+		while ( next < end )
+		{
+			unsigned char *p = ( unsigned char* ) memchr( buffer + next + 1, 0x07, end - next - 1 );
+			if ( p == NULL )
+			{
+				next = end;
+				break;
+			}
+			next = p - 1 - buffer;
+			if ( ( buffer[ next ] & 0xe0 ) == 0 && next + 2 < end && buffer[ next + 2 ] == 0 &&
+			        ( end - next < 144000 || DVFrame::IsValidFrame( buffer + next, end - next ) ) )
+				break;
+			++next;
+		}
+		skipped += next - start;
+		start = next;
+	}
+	skipped += end - start;
+
+	close( in );
+	close( out );
+	delete[] buffer;
+
+	cerr << input << ": recovered " << frames << " frames, skipped " << skipped << " bytes" << endl;
+	return EXIT_SUCCESS;
+}
+
+
+static void usage( const char *name )
+{
+	cerr << "Usage: " << name << " [-force] file.avi" << endl;
+	cerr << "       " << name << " damaged.dv recovered.dv" << endl << endl;
+	cerr << "Rebuilds the headers and indexes of an AVI file written by dvgrab in place," << endl;
+	cerr << "or copies the intact frames of a raw DV file to a new file." << endl << endl;
+	cerr << "  -force               truncate the AVI file after the last readable frame" << endl;
+	cerr << "                          even if more data follows it" << endl;
+}
+
+
+int main( int argc, char *argv[] )
+{
+	bool force = false;
+	int i = 1;
+
+	if ( i < argc && strcmp( argv[ i ], "-force" ) == 0 )
+	{
+		force = true;
+		++i;
+	}
+
+	try
+	{
+		if ( argc - i == 1 )
+			return RecoverAVI( argv[ i ], force );
+		else if ( argc - i == 2 && !force )
+			return RecoverRaw( argv[ i ], argv[ i + 1 ] );
+	}
+	catch ( string exc )
+	{
+		cerr << exc << endl;
+		return EXIT_FAILURE;
+	}
+
+	usage( argv[ 0 ] );
+	return EXIT_FAILURE;
+}
@@ -45,6 +45,10 @@ using std::ends;
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <endian.h>
 
 #include "filehandler.h"
 #include "error.h"
@@ -52,7 +56,7 @@ using std::ends;
 #include "avi.h"
 #include "frame.h"
 #include "dvframe.h"
-#include "affine.h"
+#include "hdvframe.h"
 #include "stringutils.h"
 
 FileTracker *FileTracker::instance = NULL;
@@ -168,6 +172,11 @@ int FileHandler::GetTimeSplit()
 	return timeSplit;
 }
 
+int FileHandler::GetSceneSplit()
+{
+	return sceneDetector.GetThreshold();
+}
+
 
 bool FileHandler::GetTimeStamp()
 {
@@ -237,6 +246,12 @@ void FileHandler::SetTimeSplit( int secs )
 }
 
 
+void FileHandler::SetSceneSplit( int threshold )
+{
+	sceneDetector.SetThreshold( threshold );
+}
+
+
 void FileHandler::SetTimeStamp( bool flag )
 {
 	timeStamp = flag;
@@ -324,6 +339,8 @@ bool FileHandler::WriteFrame( Frame *frame )
 	{
 		bool startNewFile = false;
 		off_t newFileSize = GetFileSize() + frame->GetDataLen();
+		if ( frame->IsHDV() )
+			newFileSize += static_cast< HDVFrame* >( frame )->GetHeadLen();
 		bool maxFileSizeExceeded = newFileSize >= GetMaxFileSize();
 		bool maxColSizeExceeded = GetCurrentCollectionSize() + newFileSize >= GetMaxColSize();
 
@@ -366,10 +383,13 @@ bool FileHandler::WriteFrame( Frame *frame )
 		}
 	}
 
+	// The scene detector must see every frame to keep its history
+	bool isSceneSplit = GetSceneSplit() != 0 && sceneDetector.IsSceneCut( frame );
+
 	// If the user wants autosplit, start a new file if a new recording is detected
 	// either by explicit frame flag or a timecode discontinuity
 	if ( FileIsOpen() && ( ( GetAutoSplit() && ( frame->IsNewRecording() || discontinuity ) )
-		|| isTimeSplit ) )
+		|| isTimeSplit || isSceneSplit ) )
 	{
 		CollectionCounterUpdate();
 		Close();
@@ -526,10 +546,47 @@ static ssize_t writen( int fd, unsigned char *vptr, size_t n )
 	return n;
 }
 
+
+/** Writes the spans in order, like writen
+
+    \param iov the spans, consumed as they are written
+    \return the number of bytes written, or -1
+*/
+
+static ssize_t writevn( int fd, struct iovec *iov, int count )
+{
+	ssize_t total = 0;
+	ssize_t nwritten;
+
+	while ( count > 0 )
+	{
+		if ( ( nwritten = writev( fd, iov, count < IOV_MAX ? count : IOV_MAX ) ) <= 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			return -1;
+		}
+		total += nwritten;
+		while ( count > 0 && ( size_t ) nwritten >= iov->iov_len )
+		{
+			nwritten -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if ( count > 0 )
+		{
+			iov->iov_base = ( unsigned char* ) iov->iov_base + nwritten;
+			iov->iov_len -= nwritten;
+		}
+	}
+	return total;
+}
+
 /***************************************************************************/
 
 
-RawHandler::RawHandler( const string& ext ) : fd( -1 )
+RawHandler::RawHandler( const string& ext ) : fd( -1 ), copyFd( -1 ), copySource( -1 ),
+		copyOffset( 0 ), copyLength( 0 )
 {
 	extension = ext;
 }
@@ -564,13 +621,86 @@ bool RawHandler::Create( const string& filename )
 
 int RawHandler::Write( Frame *frame )
 {
+#ifdef HAVE_COPY_FILE_RANGE
+	/* When remuxing from a file, the data need not pass through user
+	   space. Consecutive frames are collected into one range, so the
+	   kernel can copy large extents or share them on file systems
+	   that support reflinks. */
+
+	if ( frame->sourceFd != -1 && fd != fileno( stdout ) )
+	{
+		if ( copyFd != -1 && ( frame->sourceFd != copySource || frame->sourceOffset != copyOffset + copyLength ) )
+			if ( FlushCopy() < 0 )
+				return -1;
+		if ( copyFd == -1 )
+		{
+			// Keep our own descriptor in case the reader closes its file first
+			if ( ( copyFd = dup( frame->sourceFd ) ) == -1 )
+				return -1;
+			copySource = frame->sourceFd;
+			copyOffset = frame->sourceOffset;
+			copyLength = 0;
+		}
+		copyLength += frame->GetDataLen();
+		return frame->GetDataLen();
+	}
+	if ( FlushCopy() < 0 )
+		return -1;
+#endif
 	int result = writen( fd, frame->data, frame->GetDataLen() );
 	return result;
 }
 
 
+/** Writes out the pending range of the source file
+ 
+    Falls back to reading and writing through a buffer if the kernel
+    cannot copy between these two files.
+ 
+    \return 0 on success, -1 on error
+*/
+
+int RawHandler::FlushCopy()
+{
+	int result = 0;
+
+	if ( copyFd == -1 )
+		return 0;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	while ( copyLength > 0 )
+	{
+		ssize_t n = copy_file_range( copyFd, &copyOffset, fd, NULL, copyLength, 0 );
+		if ( n > 0 )
+			copyLength -= n;
+		else if ( n < 0 && errno == EINTR )
+			continue;
+		else
+			break;
+	}
+#endif
+	while ( copyLength > 0 )
+	{
+		unsigned char buffer[ 65536 ];
+		ssize_t n = pread( copyFd, buffer, copyLength < ( off_t ) sizeof( buffer ) ? copyLength : sizeof( buffer ), copyOffset );
+		if ( n <= 0 || writen( fd, buffer, n ) < 0 )
+		{
+			result = -1;
+			break;
+		}
+		copyOffset += n;
+		copyLength -= n;
+	}
+	close( copyFd );
+	copyFd = -1;
+	copyLength = 0;
+	return result;
+}
+
+
 int RawHandler::Close()
 {
+	FlushCopy();
 	if ( fd != -1 && fd != fileno( stdin ) && fd != fileno( stdout ) )
 	{
 		close( fd );
@@ -585,7 +715,7 @@ off_t RawHandler::GetFileSize()
 	struct stat file_status;
 	if ( fstat( fd, &file_status ) < 0 )
 		return 0;
-	return file_status.st_size;
+	return file_status.st_size + copyLength;
 }
 
 int RawHandler::GetTotalFrames()
@@ -605,7 +735,7 @@ bool RawHandler::Open( const char *s )
 	}
 	else
 	{
-		fd = open( s, O_RDWR | O_NONBLOCK );
+		fd = open( s, O_RDONLY | O_NONBLOCK );
 		if ( fd < 0 )
 			return false;
 		filename = s;
@@ -627,8 +757,16 @@ int RawHandler::GetFrame( Frame *frame, int frameNum )
 		return -1;
 	off_t offset = ( ( off_t ) frameNum * ( off_t ) size );
 	fail_if( lseek( fd, offset, SEEK_SET ) == ( off_t ) - 1 );
-	if ( read( fd, frame->data, size ) > 0 )
+	if ( read( fd, frame->data, size ) == size )
+	{
+		frame->SetDataLen( size );
+		if ( fd != fileno( stdin ) )
+		{
+			frame->sourceFd = fd;
+			frame->sourceOffset = offset;
+		}
 		return 0;
+	}
 	else
 		return -1;
 }
@@ -638,7 +776,7 @@ int RawHandler::GetFrame( Frame *frame, int frameNum )
 
 
 AVIHandler::AVIHandler( int format ) : avi( NULL ), filen( NULL ), aviFormat( format ), isOpenDML( false ),
-		fccHandler( make_fourcc( "dvsd" ) ), infoSet( false )
+		fccHandler( make_fourcc( "dvsd" ) ), infoSet( false ), checkpoint( 0 ), framesSinceCheckpoint( 0 )
 {
 	extension = ".avi";
 }
@@ -749,7 +887,17 @@ int AVIHandler::Write( Frame *frame )
 
 	assert( avi != NULL );
 
-	return ( avi->WriteFrame( frame ) ? 0 : -1 );
+	if ( !avi->WriteFrame( frame ) )
+		return -1;
+
+	/* Periodically bring the headers and indexes on disk up to date so
+	   that the file remains usable if the capture is interrupted. */
+	if ( checkpoint > 0 && ++framesSinceCheckpoint >= checkpoint * ( videoInfo.isPAL ? 25 : 30 ) )
+	{
+		avi->Checkpoint();
+		framesSinceCheckpoint = 0;
+	}
+	return 0;
 }
 
 
@@ -757,10 +905,13 @@ int AVIHandler::Close()
 {
 	if ( avi != NULL )
 	{
-		avi->WriteRIFF();
+		// A file opened with Open() is only read from
+		if ( infoSet )
+			avi->WriteRIFF();
 		delete avi;
 		avi = NULL;
 	}
+	framesSinceCheckpoint = 0;
 	return 0;
 }
 
@@ -822,6 +973,17 @@ bool AVIHandler::GetOpenDML()
 }
 
 
+/** Sets the interval of the header and index checkpoints
+ 
+    \param secs the number of seconds of video between checkpoints, 0 = never
+*/
+
+void AVIHandler::SetCheckpoint( int secs )
+{
+	checkpoint = secs;
+}
+
+
 /***************************************************************************/
 
 #ifdef HAVE_LIBQUICKTIME
@@ -851,8 +1013,8 @@ void QtHandler::Init()
 	samplingRate = 0;
 	samplesPerBuffer = 0;
 	channels = 2;
-	audioBuffer = NULL;
-	audioChannelBuffer = NULL;
+	for ( int c = 0; c < 4; c++ )
+		audioChannelBuffers[ c ] = NULL;
 	isFullyInitialized = false;
 }
 
@@ -873,20 +1035,6 @@ bool QtHandler::Create( const string& filename )
 }
 
 
-inline void QtHandler::DeinterlaceStereo16( void* pInput, int iBytes,
-        void* pLOutput, void* pROutput )
-{
-	short int * piSampleInput = ( short int* ) pInput;
-	short int* piSampleLOutput = ( short int* ) pLOutput;
-	short int* piSampleROutput = ( short int* ) pROutput;
-
-	while ( ( char* ) piSampleInput < ( ( char* ) pInput + iBytes ) )
-	{
-		*piSampleLOutput++ = *piSampleInput++;
-		*piSampleROutput++ = *piSampleInput++;
-	}
-}
-
 int QtHandler::Write( Frame *f )
 {
 	assert( !f->IsHDV() );
@@ -922,26 +1070,15 @@ int QtHandler::Write( Frame *f )
 			                     frame->GetFrameRate(), compressor );
 		}
 
+		/* The frame extracts the audio straight into one buffer per
+		   channel. It may fill all four if the tape has four channels,
+		   only the first two are encoded. */
+
 		if ( channels > 0 )
 		{
-			audioBuffer = new int16_t[ DV_AUDIO_MAX_SAMPLES * channels ];
 			audioBufferSize = DV_AUDIO_MAX_SAMPLES;
-
-			audioChannelBuffer = new short int * [ channels ];
-			for ( int c = 0; c < channels; c++ )
-				audioChannelBuffer[ c ] = new short int[ 3000 ];
-
-			assert( channels <= 4 );
-
-			for ( int c = 0; c < channels; c++ )
-				audioChannelBuffers[ c ] = audioChannelBuffer[ c ];
-		}
-		else
-		{
-			audioChannelBuffer = NULL;
-
 			for ( int c = 0; c < 4; c++ )
-				audioChannelBuffers[ c ] = NULL;
+				audioChannelBuffers[ c ] = new int16_t[ DV_AUDIO_MAX_SAMPLES ];
 		}
 
 		isFullyInitialized = true;
@@ -972,17 +1109,11 @@ int QtHandler::Write( Frame *f )
 	if ( channels > 0 )
 	{
 		AudioInfo audio;
-		frame->ExtractHeader();
-		if ( frame->GetAudioInfo( audio ) && ( unsigned int ) audio.samples < audioBufferSize )
+		if ( frame->GetAudioInfo( audio ) && ( unsigned int ) audio.samples < audioBufferSize &&
+		        frame->ExtractAudio( audioChannelBuffers ) > 0 )
 		{
-			long bytesRead = frame->ExtractAudio( audioBuffer );
-
-			DeinterlaceStereo16( audioBuffer, bytesRead,
-			                     audioChannelBuffer[ 0 ],
-			                     audioChannelBuffer[ 1 ] );
-
 			quicktime_encode_audio( fd, audioChannelBuffers,
-			                        NULL, bytesRead / 4 );
+			                        NULL, audio.samples );
 		}
 	}
 	return result;
@@ -996,17 +1127,10 @@ int QtHandler::Close()
 		quicktime_close( fd );
 		fd = NULL;
 	}
-	if ( audioBuffer != NULL )
+	for ( int c = 0; c < 4; c++ )
 	{
-		delete audioBuffer;
-		audioBuffer = NULL;
-	}
-	if ( audioChannelBuffer != NULL )
-	{
-		for ( int c = 0; c < channels; c++ )
-			delete audioChannelBuffer[ c ];
-		delete audioChannelBuffer;
-		audioChannelBuffer = NULL;
+		delete[] audioChannelBuffers[ c ];
+		audioChannelBuffers[ c ] = NULL;
 	}
 	return 0;
 }
@@ -1070,331 +1194,863 @@ int QtHandler::GetFrame( Frame *frame, int frameNum )
 
 /********************************************************************************/
 
-#if defined(HAVE_LIBJPEG) && defined(HAVE_LIBDV)
+#ifdef HAVE_LIBJPEG
 
-JPEGHandler::JPEGHandler( int quality, bool deinterlace, int width, int height,
-                          bool overwrite, string temp, bool usetemp ) :
-		isOpen( false ), count( 0 ), deinterlace( deinterlace ), overwrite( overwrite )
+/** Fills tables that map video range samples to the full range JFIF expects
+
+    \param luma set to the map for Y, 16-235
+    \param chroma set to the map for Cb and Cr, 16-240
+*/
+
+static void FillRangeTables( JSAMPLE *luma, JSAMPLE *chroma )
+{
+	for ( int i = 0; i < 256; ++i )
+	{
+		luma[ i ] = CLAMP( ( ( i - 16 ) * 255 + 109 ) / 219, 0, 255 );
+		chroma[ i ] = CLAMP( 128 + ( ( i - 128 ) * 255 + ( i < 128 ? -112 : 112 ) ) / 224, 0, 255 );
+	}
+}
+
+
+/// the black border around the thumbnails of a sheet, in pixels
+#define THUMB_GAP 2
+
+ThumbHandler::ThumbHandler( int quality, int every, int columns, int rows ) :
+		isOpen( false ), count( 0 ), every( every ), framesSinceThumb( -1 ), thumbs( 0 ), thumbHeight( 0 )
 {
 	extension = ".jpg";
+	this->columns = CLAMP( columns, 1, 64 );
+	this->rows = CLAMP( rows, 1, 64 );
+	sheet = new JSAMPLE[ ( this->columns * ( DV_DC_WIDTH + THUMB_GAP ) + THUMB_GAP ) *
+	                     ( this->rows * ( DV_DC_HEIGHT + THUMB_GAP ) + THUMB_GAP ) * 3 ];
+	FillRangeTables( lumaRange, chromaRange );
+
 	cinfo.err = jpeg_std_error( &jerr );
 	jpeg_create_compress( &cinfo );
 	cinfo.input_components = 3;		/* # of color components per pixel */
-	cinfo.in_color_space = JCS_RGB; 	/* colorspace of input image */
+	cinfo.in_color_space = JCS_YCbCr; 	/* colorspace of input image */
 	jpeg_set_defaults( &cinfo );
 	jpeg_set_quality( &cinfo, quality, TRUE /* limit to baseline-JPEG values */ );
-	new_height = CLAMP( height, -1, 2048 );
-	new_width = CLAMP( width, -1, 2048 );
-	this->temp=temp;
-	this->usetemp=usetemp;
+
+	/* a thumbnail pixel is already the average of a whole block */
+	cinfo.comp_info[ 0 ].h_samp_factor = cinfo.comp_info[ 0 ].v_samp_factor = 1;
 }
 
 
-JPEGHandler::~JPEGHandler()
+ThumbHandler::~ThumbHandler()
 {
 	Close();
 	jpeg_destroy_compress( &cinfo );
+	delete[] sheet;
 }
 
-bool JPEGHandler::Create( const string& filename )
+
+bool ThumbHandler::Create( const string& filename )
 {
 	this->filename = filename;
 	isOpen = true;
 	count = 0;
+	thumbs = 0;
+	framesSinceThumb = -1;
 	return true;
 }
 
-/* this must be called before scaling */
-/* height is fixed, returns new width */
-int JPEGHandler::fixAspect( Frame *frame )
+
+int ThumbHandler::Write( Frame *frame )
 {
 	assert( !frame->IsHDV() );
-	DVFrame *dvframe = (DVFrame*)frame;
-	int width = frame->GetWidth( );
-	int height = frame->GetHeight( );
-	static JSAMPLE image[ 2048 * 2048 * 3 ];
-	register JSAMPLE *dest = image_buffer, *src = image;
-	int new_width = dvframe->IsPAL() ? 337 : 320;
-	int n = width / 2 - new_width;
-	int d = width / 2;
-	int a = n;
-
-	memcpy( src, dest, width * height * 3 );
-
-	for ( register int j = 0; j < height; j += 2 )
-	{
-		src = image + j * ( width * 3 );
-		for ( register int i = 0; i < new_width ; i++ )
-		{
-			if ( a > d )
-			{
-				a -= d;
-				src += 3;
-			}
-			else
-				a += n;
+	DVFrame *dvframe = ( DVFrame* ) frame;
+	int stride = ( columns * ( DV_DC_WIDTH + THUMB_GAP ) + THUMB_GAP ) * 3;
 
-			*dest++ = *src++;
-			*dest++ = *src++;
-			*dest++ = *src++;
-			src += 3;
-		}
+	if ( framesSinceThumb != -1 && !frame->IsNewRecording() && ( every <= 0 || framesSinceThumb + 1 < every ) )
+	{
+		++framesSinceThumb;
+		return 0;
 	}
-	return new_width;
-}
+	framesSinceThumb = 0;
 
-bool JPEGHandler::scale( Frame *frame )
-{
-	int width = frame->GetWidth( );
-	int height = frame->GetHeight( );
-	static JSAMPLE image[ 2048 * 2048 * 3 ];
-	register JSAMPLE *dest = image_buffer, *src = image;
-	AffineTransform affine;
-	double scale_x = ( double ) new_width / ( double ) width;
-	double scale_y = ( double ) new_height / ( double ) height;
-
-	memcpy( src, dest, width * height * 3 );
-
-	register int i, j, x, y;
-	if ( scale_x <= 1.0 && scale_y <= 1.0 )
+	int height = dvframe->ExtractDC( dc );
+	if ( thumbs == 0 )
 	{
-		affine.Scale( scale_x, scale_y );
-
-		for ( j = 0; j < height; j++ )
-			for ( i = 0; i < width; i++ )
-			{
-				x = ( int ) ( affine.MapX( i - width / 2, j - height / 2 ) );
-				y = ( int ) ( affine.MapY( i - width / 2, j - height / 2 ) );
-				x += new_width / 2;
-				x = CLAMP( x, 0, new_width );
-				y += new_height / 2;
-				y = CLAMP( y, 0, new_height );
-				//cout << "i = " << i << " j = " << j << " x = " << x << " y = " << y << endl;
-				src = image + ( j * width * 3 ) + i * 3;
-				dest = image_buffer + y * ( int ) ( new_width ) * 3 + ( int ) ( x * 3 );
-				*dest++ = *src++;
-				*dest++ = *src++;
-				*dest++ = *src++;
-			}
+		JSAMPLE *p = sheet;
+		JSAMPLE *end = sheet + stride * ( rows * ( DV_DC_HEIGHT + THUMB_GAP ) + THUMB_GAP );
+		while ( p < end )
+		{
+			*p++ = 0;
+			*p++ = 128;
+			*p++ = 128;
+		}
+		thumbHeight = height;
 	}
-	else if ( scale_x >= 1.0 && scale_y >= 1.0 )
-	{
-		affine.Scale( 1.0 / scale_x, 1.0 / scale_y );
 
-		for ( y = 0; y < new_height; y++ )
-			for ( x = 0; x < new_width; x++ )
-			{
-				i = ( int ) ( affine.MapX( x - new_width / 2, y - new_height / 2 ) );
-				j = ( int ) ( affine.MapY( x - new_width / 2, y - new_height / 2 ) );
-				i += width / 2;
-				i = CLAMP( i, 0, new_width );
-				j += height / 2;
-				j = CLAMP( j, 0, new_height );
-				//cout << "i = " << i << " j = " << j << " x = " << x << " y = " << y << endl;
-				src = image + ( j * width * 3 ) + i * 3;
-				dest = image_buffer + y * ( int ) ( new_width ) * 3 + ( int ) ( x * 3 );
-				*dest++ = *src++;
-				*dest++ = *src++;
-				*dest++ = *src++;
-			}
+	JSAMPLE *cell = sheet + ( ( thumbs / columns ) * ( thumbHeight + THUMB_GAP ) + THUMB_GAP ) * stride +
+	                ( ( thumbs % columns ) * ( DV_DC_WIDTH + THUMB_GAP ) + THUMB_GAP ) * 3;
+	for ( int y = 0; y < height && y < thumbHeight; ++y )
+	{
+		const unsigned char *src = dc + y * DV_DC_WIDTH * 3;
+		JSAMPLE *dest = cell + y * stride;
+		for ( int x = 0; x < DV_DC_WIDTH; ++x )
+		{
+			*dest++ = lumaRange[ *src++ ];
+			*dest++ = chromaRange[ *src++ ];
+			*dest++ = chromaRange[ *src++ ];
+		}
 	}
-	else
-		return false;
 
-	return true;
+	if ( ++thumbs == columns * rows )
+		WriteSheet();
+	return 0;
 }
 
 
-int JPEGHandler::Write( Frame *frame )
+/** Compresses the thumbnails taken so far into the next sheet file
+
+    A sheet that is not full is cut after its last row.
+*/
+
+void ThumbHandler::WriteSheet()
 {
-	assert( !frame->IsHDV() );
-	DVFrame *dvframe = (DVFrame*)frame;
+	int stride = ( columns * ( DV_DC_WIDTH + THUMB_GAP ) + THUMB_GAP ) * 3;
+	int used = thumbs < columns ? thumbs : columns;
+	int lines = ( thumbs + columns - 1 ) / columns;
 	JSAMPROW row_pointer[ 1 ];	/* pointer to JSAMPLE row[s] */
-	int row_stride;		/* physical row width in image buffer */
-	JDIMENSION width = frame->GetWidth();
-	JDIMENSION height = frame->GetHeight();
+	ostringstream sb;
 
-	dvframe->ExtractHeader();
-	if ( frame->IsNewRecording() && GetAutoSplit() )
-		count = 0;
-	dvframe->ExtractRGB( image_buffer );
-	if ( deinterlace )
-		dvframe->Deinterlace( image_buffer, 3 );
-	if ( new_width != -1 || new_height != -1 )
-	{
-		if ( new_width == -1 )
-			new_width = width;
-		if ( new_height == -1 )
-			new_height = height;
-		if ( !scale( frame ) )
-		{
-			new_width = width;
-			new_height = height;
-		}
-	}
-	else
-	{
-		if ( new_width == -1 )
-			new_width = width;
-		if ( new_height == -1 )
-			new_height = height;
-	}
+	sb << filename.substr( 0, filename.find_last_of( '.' ) ) << "-"
+		<< setfill( '0' ) << setw( 8 ) << ++count
+		<< GetExtension() << ends;
+	file = sb.str();
+	thumbs = 0;
 
-	if ( overwrite )
-	{
-		if ( StringUtils::ends( GetBaseName(), ".jpg" ) || StringUtils::ends( GetBaseName(), ".jpeg" ) )
-		{
-			file = GetBaseName();
-		}
-		else
-		{
-			ostringstream sb;
-			sb << GetBaseName() << GetExtension() << ends;
-			file = sb.str();
-		}
-	}
-	else
+	FILE *outfile = fopen( file.c_str(), "wb" );
+	if ( outfile == NULL )
 	{
-		ostringstream sb;
-		sb << filename.substr( 0, filename.find_last_of( '.' ) ) << "-" 
-			<< setfill( '0' ) << setw( 8 ) << ++count
-			<< GetExtension() << ends;
-		file = sb.str();
-	}
-
-	FILE *outfile;
-
-	if ( this->usetemp ) {
-		outfile = fopen( const_cast<char*>( this->temp.c_str() ), "wb" );
-	} else {
-		outfile = fopen( const_cast<char*>( file.c_str() ), "wb" );
+		sendEvent( ">>> Error creating file %s: %s", file.c_str(), strerror( errno ) );
+		return;
 	}
-	if ( outfile != NULL )
-		jpeg_stdio_dest( &cinfo, outfile );
-	cinfo.image_width = new_width;
-	cinfo.image_height = new_height;
-	row_stride = cinfo.image_width * cinfo.input_components;
+	jpeg_stdio_dest( &cinfo, outfile );
+	cinfo.image_width = used * ( DV_DC_WIDTH + THUMB_GAP ) + THUMB_GAP;
+	cinfo.image_height = lines * ( thumbHeight + THUMB_GAP ) + THUMB_GAP;
 	jpeg_start_compress( &cinfo, TRUE );
 	while ( cinfo.next_scanline < cinfo.image_height )
 	{
-		row_pointer[ 0 ] = &image_buffer[ cinfo.next_scanline * row_stride ];
+		row_pointer[ 0 ] = &sheet[ cinfo.next_scanline * stride ];
 		jpeg_write_scanlines( &cinfo, row_pointer, 1 );
 	}
 	jpeg_finish_compress( &cinfo );
 	fclose( outfile );
-	if ( this->usetemp ) {
-		rename(const_cast<char*>( this->temp.c_str() ), const_cast<char*>( file.c_str() ));
-	}
-	return 0;
 }
 
-int JPEGHandler::Close( void )
+
+int ThumbHandler::Close( void )
 {
+	if ( thumbs > 0 )
+		WriteSheet();
 	isOpen = false;
 	return 0;
 }
 
 #endif
 
+/********************************************************************************/
 
-/***************************************************************************/
+#if defined(HAVE_LIBJPEG) && defined(HAVE_LIBDV)
 
+/// the initial size of a worker's compressed image buffer
+#define JPEG_OUTPUT_SIZE ( 256 * 1024 )
 
-Mpeg2Handler::Mpeg2Handler( unsigned char flags, const string& ext ) :
-	fd( -1 ), waitingForRecordingDate( true ), bufferLen( 0 ), totalFrames( 0 ),
-	writerFlags( flags ), firstPayloadEntry( NULL )
-{
-	extension = ext;
-}
+/// libjpeg reads raw data in whole blocks, so plane lines are padded to them
+#define JPEG_STRIDE( width ) ( ( ( width ) + DCTSIZE - 1 ) & ~( DCTSIZE - 1 ) )
 
-Mpeg2Handler::~Mpeg2Handler()
+JPEGWorker::JPEGWorker( JPEGHandler *handler, int quality ) :
+		handler( handler ), output( NULL ), outputSize( 0 ), outputCapacity( 0 )
 {
-	PayloadList *next;
-	while ( firstPayloadEntry != NULL ) {
-	    next = firstPayloadEntry->next;
-	    free( firstPayloadEntry );
-	    firstPayloadEntry = next;
-	}	
-	Close();
+	cinfo.err = jpeg_std_error( &jerr );
+	jpeg_create_compress( &cinfo );
+	cinfo.input_components = 3;		/* # of color components per pixel */
+	cinfo.in_color_space = JCS_YCbCr; 	/* colorspace of input image */
+	jpeg_set_defaults( &cinfo );
+	jpeg_set_quality( &cinfo, quality, TRUE /* limit to baseline-JPEG values */ );
+	cinfo.raw_data_in = TRUE;
+	cinfo.client_data = this;
+	dest.init_destination = InitDestination;
+	dest.empty_output_buffer = EmptyOutputBuffer;
+	dest.term_destination = TermDestination;
+	cinfo.dest = &dest;
+
+	image_buffer = new JSAMPLE[ FRAME_MAX_WIDTH * FRAME_MAX_HEIGHT * 2 ];
+	planes[ 0 ] = new JSAMPLE[ FRAME_MAX_WIDTH * FRAME_MAX_HEIGHT ];
+	planes[ 1 ] = new JSAMPLE[ FRAME_MAX_WIDTH / 2 * FRAME_MAX_HEIGHT ];
+	planes[ 2 ] = new JSAMPLE[ FRAME_MAX_WIDTH / 2 * FRAME_MAX_HEIGHT ];
+	FillRangeTables( lumaRange, chromaRange );
+	scaled[ 0 ] = scaled[ 1 ] = scaled[ 2 ] = NULL;
+	if ( handler->new_width != -1 || handler->new_height != -1 )
+	{
+		int width = handler->new_width != -1 ? handler->new_width : FRAME_MAX_WIDTH;
+		int height = handler->new_height != -1 ? handler->new_height : FRAME_MAX_HEIGHT;
+		scaled[ 0 ] = new JSAMPLE[ JPEG_STRIDE( width ) * height ];
+		scaled[ 1 ] = new JSAMPLE[ JPEG_STRIDE( ( width + 1 ) / 2 ) * height ];
+		scaled[ 2 ] = new JSAMPLE[ JPEG_STRIDE( ( width + 1 ) / 2 ) * height ];
+	}
 }
 
-bool Mpeg2Handler::FileIsOpen()
-{
-	return fd != -1;
-}
 
-bool Mpeg2Handler::Create( const string& filename )
+JPEGWorker::~JPEGWorker()
 {
-	if ( GetBaseName() == "-" )
-		fd = fileno( stdout );
-	else
-		fd = open( filename.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_NONBLOCK, 0644 );
-	if ( fd != -1 )
+	jpeg_destroy_compress( &cinfo );
+	delete[] image_buffer;
+	for ( int i = 0; i < 3; ++i )
 	{
-		FileTracker::GetInstance().Add( filename.c_str() );
-		this->filename = filename;
+		delete[] planes[ i ];
+		delete[] scaled[ i ];
 	}
-	return ( fd != -1 );
+	free( output );
 }
 
-bool Mpeg2Handler::WriteFrame( Frame *frame )
+
+void JPEGWorker::InitDestination( j_compress_ptr cinfo )
 {
-	if ( waitingForRecordingDate )
-	{
-		struct tm rd;
-		if ( !frame->GetRecordingDate( rd ) )
-		{
-			if ( bufferLen + frame->GetDataLen() < MPEG2_BUFFER_SIZE )
-			{
-				// Buffer up the first several frames until we get the recording date
-				memcpy( &buffer[bufferLen], frame->data, frame->GetDataLen() );
-				bufferLen += frame->GetDataLen();
-				totalFrames++;
-				return true;
-			}
-		}
+	JPEGWorker *worker = static_cast< JPEGWorker* >( cinfo->client_data );
 
-		waitingForRecordingDate = false;
+	if ( worker->output == NULL )
+	{
+		fail_null( worker->output = ( JOCTET* ) malloc( JPEG_OUTPUT_SIZE ) );
+		worker->outputCapacity = JPEG_OUTPUT_SIZE;
 	}
+	worker->dest.next_output_byte = worker->output;
+	worker->dest.free_in_buffer = worker->outputCapacity;
+}
 
-	return FileHandler::WriteFrame( frame );
+
+/* libjpeg calls this when the whole buffer is full, so it just grows */
+boolean JPEGWorker::EmptyOutputBuffer( j_compress_ptr cinfo )
+{
+	JPEGWorker *worker = static_cast< JPEGWorker* >( cinfo->client_data );
+	size_t used = worker->outputCapacity;
+
+	worker->outputCapacity *= 2;
+	fail_null( worker->output = ( JOCTET* ) realloc( worker->output, worker->outputCapacity ) );
+	worker->dest.next_output_byte = worker->output + used;
+	worker->dest.free_in_buffer = worker->outputCapacity - used;
+	return TRUE;
 }
 
-int Mpeg2Handler::Write( Frame *frame )
+
+void JPEGWorker::TermDestination( j_compress_ptr cinfo )
 {
-	int result;
+	JPEGWorker *worker = static_cast< JPEGWorker* >( cinfo->client_data );
+	worker->outputSize = worker->outputCapacity - worker->dest.free_in_buffer;
+}
 
-	// Write any buffered data first.
-	if ( bufferLen > 0 )
-	{
-		if ( frame->CouldBeJVCP25() && ( writerFlags & MPEG2_JVC_P25 ) )
-			result = writeJVCP25( buffer, bufferLen );
-		else
-			result = writen( fd, buffer, bufferLen );
-		if ( 0 > result )
-			return result;
-		bufferLen = 0;
-	}
 
-	if ( frame->CouldBeJVCP25() && ( writerFlags & MPEG2_JVC_P25 ) )
-		result = writeJVCP25( frame->data, frame->GetDataLen() );
-	else
-		result = writen( fd, frame->data, frame->GetDataLen() );
+/** Splits the YUY2 image_buffer into planes
 
-	if ( 0 <= result )
-		totalFrames++;
+    The chroma planes keep the horizontal subsampling of YUY2. With
+    vertical subsampling, each chroma line is the average of two.
+    The samples are expanded from video range to the full range JFIF
+    expects.
 
-	return result;
-}
+    \param width the size of the frame
+    \param height the size of the frame
+    \param vsamp 2 for 4:2:0 chroma, 1 otherwise
+*/
 
-int Mpeg2Handler::Close()
+void JPEGWorker::Unpack( int width, int height, int vsamp )
 {
-	if ( fd != -1 && fd != fileno( stdin ) && fd != fileno( stdout ) )
+	JSAMPLE *y = planes[ 0 ];
+	JSAMPLE *cb = planes[ 1 ];
+	JSAMPLE *cr = planes[ 2 ];
+
+	for ( int j = 0; j < height; j += vsamp )
 	{
-		close( fd );
-		fd = -1;
+		JSAMPLE *src = image_buffer + j * width * 2;
+		JSAMPLE *next = src + ( vsamp - 1 ) * width * 2;
+
+		for ( int i = 0; i < width * vsamp; ++i )
+			*y++ = lumaRange[ src[ 2 * i ] ];
+		for ( int i = 0; i < width * 2; i += 4 )
+		{
+			*cb++ = chromaRange[ ( src[ i + 1 ] + next[ i + 1 ] + 1 ) >> 1 ];
+			*cr++ = chromaRange[ ( src[ i + 3 ] + next[ i + 3 ] + 1 ) >> 1 ];
+		}
 	}
-	return 0;
+}
+
+
+/// fraction bits of the resampling weights
+#define RESIZE_BITS 14
+#define RESIZE_ONE ( 1 << RESIZE_BITS )
+/// fraction bits kept between the vertical and the horizontal pass
+#define RESIZE_ROW_BITS 6
+
+/** Computes the filter that resamples one dimension
+
+    Shrinking averages the source samples each new sample covers,
+    weighted by how much of them it covers. Growing interpolates
+    linearly between the two nearest source samples.
+
+    \param size the number of source samples
+    \param new_size the number of samples to make
+    \param index set to taps source indexes for each new sample
+    \param weights set to the weights of the taps, summing to RESIZE_ONE
+    \return the number of taps per new sample
+*/
+
+static int ResizeFilter( int size, int new_size, vector< int > &index, vector< int > &weights )
+{
+	double ratio = ( double ) size / new_size;
+	int taps = 2;
+
+	if ( new_size < size )
+		taps = ( int ) ceil( ratio ) + ( ratio != floor( ratio ) ? 1 : 0 );
+	index.resize( new_size * taps );
+	weights.assign( new_size * taps, 0 );
+
+	for ( int i = 0; i < new_size; ++i )
+	{
+		int *w = &weights[ i * taps ];
+		int first;
+
+		if ( new_size < size )
+		{
+			double start = i * ratio;
+			double end = start + ratio;
+			first = ( int ) start;
+			for ( int t = 0; t < taps; ++t )
+			{
+				double covered = ( end < first + t + 1 ? end : first + t + 1 ) - ( start > first + t ? start : first + t );
+				if ( covered > 0 )
+					w[ t ] = ( int ) ( covered / ratio * RESIZE_ONE + 0.5 );
+			}
+		}
+		else
+		{
+			double x = ( i + 0.5 ) * ratio - 0.5;
+			first = ( int ) floor( x );
+			w[ 1 ] = ( int ) ( ( x - first ) * RESIZE_ONE + 0.5 );
+			w[ 0 ] = RESIZE_ONE - w[ 1 ];
+		}
+
+		/* make the weights add up exactly, and keep all taps inside the source */
+		int sum = 0;
+		int largest = 0;
+		for ( int t = 0; t < taps; ++t )
+		{
+			sum += w[ t ];
+			if ( w[ t ] > w[ largest ] )
+				largest = t;
+			index[ i * taps + t ] = CLAMP( first + t, 0, size - 1 );
+		}
+		w[ largest ] += RESIZE_ONE - sum;
+	}
+	return taps;
+}
+
+
+/** Scales a plane with separable filters
+
+    Each line of the result is made from the source lines it needs,
+    vertically first, in rowBuffer. Lines of the result are padded to
+    whole blocks by repeating their last sample.
+
+    \param image the plane to scale
+    \param width the size of image
+    \param height the size of image
+    \param stride the distance between lines of image
+    \param dest the plane to write
+    \param new_width the size to scale to
+    \param new_height the size to scale to
+    \param new_stride the distance between lines of dest
+*/
+
+void JPEGWorker::scale( const JSAMPLE *image, int width, int height, int stride,
+                        JSAMPLE *dest, int new_width, int new_height, int new_stride )
+{
+	int xtaps = ResizeFilter( width, new_width, columnIndex, columnWeights );
+	int ytaps = ResizeFilter( height, new_height, rowIndex, rowWeights );
+
+	rowBuffer.resize( width );
+	int *row = &rowBuffer[ 0 ];
+
+	for ( int y = 0; y < new_height; ++y )
+	{
+		const int *index = &rowIndex[ y * ytaps ];
+		const int *weights = &rowWeights[ y * ytaps ];
+		const JSAMPLE *src = image + index[ 0 ] * stride;
+		int w = weights[ 0 ];
+
+		for ( int x = 0; x < width; ++x )
+			row[ x ] = w * src[ x ];
+		for ( int t = 1; t < ytaps; ++t )
+		{
+			src = image + index[ t ] * stride;
+			w = weights[ t ];
+			if ( w != 0 )
+				for ( int x = 0; x < width; ++x )
+					row[ x ] += w * src[ x ];
+		}
+		for ( int x = 0; x < width; ++x )
+			row[ x ] = ( row[ x ] + ( 1 << ( RESIZE_BITS - RESIZE_ROW_BITS - 1 ) ) ) >> ( RESIZE_BITS - RESIZE_ROW_BITS );
+
+		JSAMPLE *out = dest + y * new_stride;
+		index = &columnIndex[ 0 ];
+		weights = &columnWeights[ 0 ];
+		for ( int x = 0; x < new_width; ++x, index += xtaps, weights += xtaps )
+		{
+			int sum = 0;
+			for ( int t = 0; t < xtaps; ++t )
+				sum += weights[ t ] * row[ index[ t ] ];
+			out[ x ] = ( sum + ( 1 << ( RESIZE_BITS + RESIZE_ROW_BITS - 1 ) ) ) >> ( RESIZE_BITS + RESIZE_ROW_BITS );
+		}
+		memset( out + new_width, out[ new_width - 1 ], new_stride - new_width );
+	}
+}
+
+
+/** Decodes, scales and compresses the frame of a job into output
+
+    libdv decodes to YUY2, which is handed to libjpeg as raw YCbCr,
+    so there is no colour conversion on either side. The chroma is
+    sampled as in the DV frame: 4:2:0 for PAL IEC 61834 DV, 4:2:2
+    for everything else, where libdv has doubled the 4:1:1 chroma.
+
+    \param job the job to encode
+*/
+
+void JPEGWorker::Encode( JPEGJob *job )
+{
+	DVFrame *frame = &job->frame;
+	JSAMPROW rows[ 3 ][ 2 * DCTSIZE ];
+	JSAMPARRAY data[ 3 ] = { rows[ 0 ], rows[ 1 ], rows[ 2 ] };
+	JSAMPLE *image[ 3 ] = { planes[ 0 ], planes[ 1 ], planes[ 2 ] };
+	int width = frame->GetWidth();
+	int height = frame->GetHeight();
+	int stride[ 3 ] = { width, width / 2, width / 2 };
+	int vsamp;
+
+	if ( handler->preview )
+		frame->ExtractPreviewYUV( image_buffer );
+	else
+		frame->ExtractYUV( image_buffer );
+	if ( handler->deinterlace )
+		frame->Deinterlace( image_buffer, 2 );
+	vsamp = frame->decoder->sampling == e_dv_sample_420 ? 2 : 1;
+	Unpack( width, height, vsamp );
+
+	int new_width = handler->new_width != -1 ? handler->new_width : width;
+	int new_height = handler->new_height != -1 ? handler->new_height : height;
+	if ( new_width != width || new_height != height )
+	{
+		int new_stride[ 3 ] = { JPEG_STRIDE( new_width ), JPEG_STRIDE( ( new_width + 1 ) / 2 ), JPEG_STRIDE( ( new_width + 1 ) / 2 ) };
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			int hsub = c == 0 ? 1 : 2;
+			int vsub = c == 0 ? 1 : vsamp;
+			scale( planes[ c ], width / hsub, height / vsub, stride[ c ], scaled[ c ],
+			       ( new_width + hsub - 1 ) / hsub, ( new_height + vsub - 1 ) / vsub, new_stride[ c ] );
+			image[ c ] = scaled[ c ];
+			stride[ c ] = new_stride[ c ];
+		}
+		width = new_width;
+		height = new_height;
+	}
+
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.comp_info[ 0 ].h_samp_factor = 2;
+	cinfo.comp_info[ 0 ].v_samp_factor = vsamp;
+	for ( int c = 1; c < 3; ++c )
+		cinfo.comp_info[ c ].h_samp_factor = cinfo.comp_info[ c ].v_samp_factor = 1;
+
+	/* libjpeg takes a block row of every plane at a time; the lines
+	   past the bottom repeat the last one */
+
+	int chroma_height = ( height + vsamp - 1 ) / vsamp;
+	jpeg_start_compress( &cinfo, TRUE );
+	while ( cinfo.next_scanline < cinfo.image_height )
+	{
+		int line = cinfo.next_scanline;
+		for ( int i = 0; i < vsamp * DCTSIZE; ++i )
+			rows[ 0 ][ i ] = image[ 0 ] + CLAMP( line + i, 0, height - 1 ) * stride[ 0 ];
+		for ( int c = 1; c < 3; ++c )
+			for ( int i = 0; i < DCTSIZE; ++i )
+				rows[ c ][ i ] = image[ c ] + CLAMP( line / vsamp + i, 0, chroma_height - 1 ) * stride[ c ];
+		jpeg_write_raw_data( &cinfo, data, vsamp * DCTSIZE );
+	}
+	jpeg_finish_compress( &cinfo );
+}
+
+
+JPEGHandler::JPEGHandler( int quality, bool deinterlace, int width, int height,
+                          bool overwrite, string temp, bool usetemp, int threads, bool preview ) :
+		isOpen( false ), count( 0 ), deinterlace( deinterlace ), overwrite( overwrite ), preview( preview ),
+		nextSequence( 0 ), nextCommit( 0 ), stopping( false )
+{
+	extension = ".jpg";
+	new_height = CLAMP( height, -1, 2048 );
+	new_width = CLAMP( width, -1, 2048 );
+	this->temp=temp;
+	this->usetemp=usetemp;
+
+	pthread_mutex_init( &mutex, NULL );
+	pthread_cond_init( &jobQueued, NULL );
+	pthread_cond_init( &jobDone, NULL );
+
+	/* Two jobs per worker let the capture thread fill the next frame
+	   while every worker is busy. The DVFrames, and their decoders,
+	   are all created here, before any thread runs. */
+
+	threads = CLAMP( threads, 1, 64 );
+	for ( int i = 0; i < 2 * threads; ++i )
+	{
+		jobs.push_back( new JPEGJob );
+		freeJobs.push_back( jobs.back() );
+	}
+	for ( int i = 0; i < threads; ++i )
+	{
+		JPEGWorker *worker = new JPEGWorker( this, quality );
+		fail_neg( pthread_create( &worker->thread, NULL, WorkerThread, worker ) );
+		workers.push_back( worker );
+	}
+}
+
+
+JPEGHandler::~JPEGHandler()
+{
+	Close();
+
+	pthread_mutex_lock( &mutex );
+	stopping = true;
+	pthread_cond_broadcast( &jobQueued );
+	pthread_mutex_unlock( &mutex );
+	for ( unsigned int i = 0; i < workers.size(); ++i )
+	{
+		pthread_join( workers[ i ]->thread, NULL );
+		delete workers[ i ];
+	}
+	for ( unsigned int i = 0; i < jobs.size(); ++i )
+		delete jobs[ i ];
+
+	pthread_cond_destroy( &jobDone );
+	pthread_cond_destroy( &jobQueued );
+	pthread_mutex_destroy( &mutex );
+}
+
+bool JPEGHandler::Create( const string& filename )
+{
+	this->filename = filename;
+	isOpen = true;
+	count = 0;
+	return true;
+}
+
+
+/** Takes queued jobs until the handler is destroyed
+
+    Jobs are encoded in parallel, but each worker waits for the jobs
+    queued before its own to be written before writing its file.
+*/
+
+void *JPEGHandler::WorkerThread( void *arg )
+{
+	JPEGWorker *worker = static_cast< JPEGWorker* >( arg );
+	JPEGHandler *handler = worker->handler;
+
+	pthread_mutex_lock( &handler->mutex );
+	while ( true )
+	{
+		while ( handler->queue.empty() && !handler->stopping )
+			pthread_cond_wait( &handler->jobQueued, &handler->mutex );
+		if ( handler->queue.empty() )
+			break;
+		JPEGJob *job = handler->queue.front();
+		handler->queue.pop_front();
+		pthread_mutex_unlock( &handler->mutex );
+
+		worker->Encode( job );
+
+		pthread_mutex_lock( &handler->mutex );
+		while ( handler->nextCommit != job->sequence )
+			pthread_cond_wait( &handler->jobDone, &handler->mutex );
+		pthread_mutex_unlock( &handler->mutex );
+
+		handler->Commit( worker, job );
+
+		pthread_mutex_lock( &handler->mutex );
+		handler->nextCommit++;
+		handler->freeJobs.push_back( job );
+		pthread_cond_broadcast( &handler->jobDone );
+	}
+	pthread_mutex_unlock( &handler->mutex );
+	return NULL;
+}
+
+
+/** Writes the compressed image of a job to its file
+
+    With a temporary file the image appears under its name only once
+    it is complete.
+
+    \param worker the worker holding the compressed image
+    \param job the job that was encoded
+*/
+
+void JPEGHandler::Commit( JPEGWorker *worker, JPEGJob *job )
+{
+	const char *name = usetemp ? temp.c_str() : job->file.c_str();
+	FILE *outfile = fopen( name, "wb" );
+
+	if ( outfile == NULL )
+	{
+		sendEvent( ">>> Error creating file %s: %s", name, strerror( errno ) );
+		return;
+	}
+	if ( fwrite( worker->output, 1, worker->outputSize, outfile ) != worker->outputSize )
+		sendEvent( ">>> Error writing file %s: %s", name, strerror( errno ) );
+	fclose( outfile );
+	if ( usetemp )
+		rename( temp.c_str(), job->file.c_str() );
+}
+
+
+int JPEGHandler::Write( Frame *frame )
+{
+	assert( !frame->IsHDV() );
+	JPEGJob *job;
+
+	if ( frame->IsNewRecording() && GetAutoSplit() )
+		count = 0;
+
+	if ( overwrite )
+	{
+		if ( StringUtils::ends( GetBaseName(), ".jpg" ) || StringUtils::ends( GetBaseName(), ".jpeg" ) )
+		{
+			file = GetBaseName();
+		}
+		else
+		{
+			ostringstream sb;
+			sb << GetBaseName() << GetExtension() << ends;
+			file = sb.str();
+		}
+	}
+	else
+	{
+		ostringstream sb;
+		sb << filename.substr( 0, filename.find_last_of( '.' ) ) << "-" 
+			<< setfill( '0' ) << setw( 8 ) << ++count
+			<< GetExtension() << ends;
+		file = sb.str();
+	}
+
+	/* Only wait here if every job is taken, which means the workers
+	   cannot keep up. */
+
+	pthread_mutex_lock( &mutex );
+	while ( freeJobs.empty() )
+		pthread_cond_wait( &jobDone, &mutex );
+	job = freeJobs.front();
+	freeJobs.pop_front();
+	pthread_mutex_unlock( &mutex );
+
+	memcpy( job->frame.data, frame->data, frame->GetDataLen() );
+	job->frame.SetDataLen( frame->GetDataLen() );
+	job->file = file;
+
+	pthread_mutex_lock( &mutex );
+	job->sequence = nextSequence++;
+	queue.push_back( job );
+	pthread_cond_signal( &jobQueued );
+	pthread_mutex_unlock( &mutex );
+	return 0;
+}
+
+int JPEGHandler::Close( void )
+{
+	/* the files of all frames written so far must exist when this returns */
+	pthread_mutex_lock( &mutex );
+	while ( nextCommit != nextSequence )
+		pthread_cond_wait( &jobDone, &mutex );
+	pthread_mutex_unlock( &mutex );
+	isOpen = false;
+	return 0;
+}
+
+#endif
+
+
+/***************************************************************************/
+
+
+Mpeg2Handler::Mpeg2Handler( unsigned char flags, const string& ext ) :
+	fd( -1 ), waitingForRecordingDate( true ), bufferLen( 0 ), totalFrames( 0 ),
+	writerFlags( flags ), fileOffset( 0 ), audioDemuxer( NULL )
+{
+	extension = ext;
+	memset( p25State, 0, sizeof( p25State ) );
+	if ( writerFlags & MPEG2_AUDIO )
+		audioDemuxer = new AudioDemuxer();
+}
+
+Mpeg2Handler::~Mpeg2Handler()
+{
+	Close();
+	delete audioDemuxer;
+}
+
+/** Sets the packets to write, all of them by default */
+
+void Mpeg2Handler::SetPIDFilter( const PIDFilter &filter )
+{
+	pidFilter = filter;
+}
+
+bool Mpeg2Handler::FileIsOpen()
+{
+	return fd != -1;
+}
+
+bool Mpeg2Handler::Create( const string& filename )
+{
+	if ( GetBaseName() == "-" )
+		fd = fileno( stdout );
+	else
+		fd = open( filename.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_NONBLOCK, 0644 );
+	if ( fd != -1 )
+	{
+		FileTracker::GetInstance().Add( filename.c_str() );
+		this->filename = filename;
+		fileOffset = 0;
+		if ( ( writerFlags & MPEG2_GOP_INDEX ) && fd != fileno( stdout ) )
+			gopIndex.Open( filename );
+		if ( audioDemuxer && fd != fileno( stdout ) )
+			audioDemuxer->Open( filename );
+	}
+	return ( fd != -1 );
+}
+
+bool Mpeg2Handler::WriteFrame( Frame *frame )
+{
+	if ( waitingForRecordingDate )
+	{
+		struct tm rd;
+		if ( !frame->GetRecordingDate( rd ) )
+		{
+			HDVFrame *hdvFrame = frame->IsHDV() ? static_cast< HDVFrame* >( frame ) : NULL;
+			int headLen = hdvFrame ? hdvFrame->GetHeadLen() : 0;
+			if ( bufferLen + headLen + frame->GetDataLen() < MPEG2_BUFFER_SIZE )
+			{
+				// Buffer up the first several frames until we get the recording date
+				if ( hdvFrame && hdvFrame->IsGOP() && ( writerFlags & MPEG2_GOP_INDEX ) )
+					bufferedGOPs.push_back( GOPIndexEntry( bufferLen, *hdvFrame ) );
+				spans.clear();
+				if ( hdvFrame )
+					pidFilter.SetStreamPIDs( hdvFrame->GetVideoPID(), hdvFrame->GetAudioPID() );
+				for ( int i = 0; hdvFrame && i < hdvFrame->GetHeadCount(); i++ )
+				{
+					int length;
+					unsigned char *head = hdvFrame->GetHead( i, length );
+					addPackets( head, length, hdvFrame->GetAudioPID() );
+				}
+				addPackets( frame->data, frame->GetDataLen(), hdvFrame ? hdvFrame->GetAudioPID() : 0 );
+				for ( unsigned int i = 0; i < spans.size(); i++ )
+				{
+					memcpy( &buffer[bufferLen], spans[ i ].iov_base, spans[ i ].iov_len );
+					bufferLen += spans[ i ].iov_len;
+				}
+				totalFrames++;
+				return true;
+			}
+		}
+
+		waitingForRecordingDate = false;
+	}
+
+	return FileHandler::WriteFrame( frame );
+}
+
+int Mpeg2Handler::Write( Frame *frame )
+{
+	HDVFrame *hdvFrame = frame->IsHDV() ? static_cast< HDVFrame* >( frame ) : NULL;
+	int result;
+
+	// Any buffered data first, then the packets the frame shares with
+	// the previous frames, then its own packets, all in one write.
+	spans.clear();
+	addSpan( buffer, bufferLen );
+	if ( hdvFrame )
+		pidFilter.SetStreamPIDs( hdvFrame->GetVideoPID(), hdvFrame->GetAudioPID() );
+	for ( int i = 0; hdvFrame && i < hdvFrame->GetHeadCount(); i++ )
+	{
+		int length;
+		unsigned char *head = hdvFrame->GetHead( i, length );
+		addPackets( head, length, hdvFrame->GetAudioPID() );
+	}
+	addPackets( frame->data, frame->GetDataLen(), hdvFrame ? hdvFrame->GetAudioPID() : 0 );
+
+	if ( frame->CouldBeJVCP25() && ( writerFlags & MPEG2_JVC_P25 ) )
+		for ( unsigned int i = 0; i < spans.size(); i++ )
+			CorrectJVCP25( ( unsigned char* ) spans[ i ].iov_base, spans[ i ].iov_len );
+
+	result = spans.empty() ? 0 : writevn( fd, &spans[ 0 ], spans.size() );
+
+	if ( 0 <= result )
+	{
+		for ( unsigned int i = 0; i < bufferedGOPs.size(); i++ )
+		{
+			bufferedGOPs[ i ].offset = htole64( fileOffset + le64toh( bufferedGOPs[ i ].offset ) );
+			gopIndex.Add( bufferedGOPs[ i ] );
+		}
+		bufferedGOPs.clear();
+		if ( hdvFrame && hdvFrame->IsGOP() && ( writerFlags & MPEG2_GOP_INDEX ) )
+			gopIndex.Add( GOPIndexEntry( fileOffset + bufferLen, *hdvFrame ) );
+
+		fileOffset += result;
+		bufferLen = 0;
+		totalFrames++;
+	}
+	if ( audioDemuxer )
+		audioDemuxer->Commit();
+
+	return result;
+}
+
+void Mpeg2Handler::addSpan( unsigned char *data, int len )
+{
+	if ( len > 0 )
+	{
+		struct iovec span = { data, ( size_t ) len };
+		spans.push_back( span );
+	}
+}
+
+/** Adds the spans of the packets the PID filter keeps
+
+    The audio demuxer copies the audio packets before the filter, so
+    the .mp2 file has the audio even when the video file does not.
+*/
+void Mpeg2Handler::addPackets( unsigned char *data, int len, int audioPID )
+{
+	if ( audioDemuxer )
+		audioDemuxer->Add( data, len, audioPID );
+	if ( pidFilter.IsEnabled() )
+		pidFilter.Filter( data, len, spans );
+	else
+		addSpan( data, len );
+}
+
+int Mpeg2Handler::Close()
+{
+	if ( fd != -1 && fd != fileno( stdin ) && fd != fileno( stdout ) )
+	{
+		close( fd );
+		fd = -1;
+	}
+	gopIndex.Close();
+	if ( audioDemuxer )
+		audioDemuxer->Close();
+	return 0;
 }
 
 off_t Mpeg2Handler::GetFileSize()
@@ -1420,40 +2076,56 @@ int Mpeg2Handler::GetFrame( Frame *frame, int frameNum )
 	return -1;
 }
 
-static inline
-int CorrectP25( unsigned char *data, unsigned char len, unsigned char *state )
-{
-	int i;
+/** Patches the headers of an MPEG-2 video payload for 25p
+
+    The frame_rate_code of a sequence header is set to 25 fps and
+    repeat_first_field of a picture coding extension is cleared. Both
+    fields are in the eighth byte from the start code on. Away from a
+    header the payload is skipped from start code prefix to start code
+    prefix. A header may continue in the next packet, so the position
+    within it is kept in state.
+
+    \param data the payload
+    \param len the number of bytes of the payload
+    \param state the position within a start code or header: 0 outside,
+    1 and 2 after zero bytes, 3 after a prefix, 4 to 7 in a sequence header
+    and 14 to 17 in an extension
+*/
 
-	for (i=0; i<len; i++)
+static void CorrectP25( unsigned char *data, int len, unsigned char &state )
+{
+	for ( int i = 0; i < len; i++ )
 	{
-		switch (*state)
+		if ( 0 == state )
+			i = FindStartCodePrefix( data, i, len );
+
+		switch ( state )
 		{
 		/* seek for start code prefix 0x00 0x00 0x01 */
 		case 0:
 		case 1:
 			if ( 0x00 == data[i] )
-				(*state)++;
+				state++;
 			else
-				*state = 0;
+				state = 0;
 			break;
 
 		case 2:
 			if ( 0x01 == data[i] )
-				*state = 3;
-			else
-				*state = 0;
+				state = 3;
+			else if ( 0x00 != data[i] )
+				state = 0;
 			break;
 
 		/* seek for start code values of sequence_header or */
 		/* picture coding extension header */
 		case 3:
 			if ( SEQUENCE_HEADER_CODE_VALUE == data[i] ) /* Sequence Header? => ignore next 3 bytes */
-				*state = 4;
+				state = 4;
 			else if ( EXTENSION_START_CODE_VALUE == data[i] ) /* Extension Header? */
-				*state = 14;
+				state = 14;
 			else
-				*state = 0;
+				state = 0;
 			break;
 
 		/* read over three more bytes */
@@ -1462,14 +2134,14 @@ int CorrectP25( unsigned char *data, unsigned char len, unsigned char *state )
 		case 6:
 		case 15:
 		case 16:
-			(*state)++;
+			state++;
 			break;
 
 		case 14:
 			if ( PICTURE_CODING_EXTENSION_ID_VALUE  == (data[i] >> 4) )   /* Picture Coding extension ?*/
-				*state = 15;
+				state = 15;
 			else
-				*state = 0;
+				state = 0;
 			break;
 
 		/* the eights bit has to be changed for both parameters */
@@ -1482,7 +2154,7 @@ int CorrectP25( unsigned char *data, unsigned char len, unsigned char *state )
 			/* works only with value of 50fps */
 			/* data[i] ^= 0x05; */
 			data[i] = ( data[i] & 0xF0 ) | 0x03;
-			*state = 0;
+			state = 0;
 			break;
 
 		case 17:
@@ -1490,42 +2162,21 @@ int CorrectP25( unsigned char *data, unsigned char len, unsigned char *state )
 			/* value |=  0x02 flag set	 */
 			/* value &= ~0x02 flag unset	 */
 			data[i] &= ~0x02;	
-			*state = 0;
+			state = 0;
 			break;
 
 		default:
 			/* undefined state */
-			return -1;
+			state = 0;
+			break;
 		} /* switch */
-    } /* for */
-    return 0;
+	} /* for */
 }
 
 
 void Mpeg2Handler::ProcessPayload( unsigned char *packet, unsigned int pid, unsigned char len )
 {
-	static PayloadList	*current = NULL;
-	
-	if ( NULL != firstPayloadEntry ) /* look for the struct for the current pid */
-		for ( current=firstPayloadEntry; ( ( NULL!=current ) && ( pid!=current->pid ) ); current=current->next );
-	
-	if (NULL == current)
-	{
-		current = ( PayloadList* ) malloc( sizeof(PayloadList) );
-		if ( NULL == current )
-		{
-			fprintf( stderr, "Error allocating memory!\n" );
-			exit( 1 );
-		}
-	
-		if ( NULL == firstPayloadEntry )
-			firstPayloadEntry = current;
-	
-		current->pid = pid;
-		current->state = 0;
-		current->next = NULL;
-	} /* if */
-	CorrectP25( packet, len, &(current->state) );
+	CorrectP25( packet, len, p25State[ pid ] );
 }
 
 
@@ -1553,69 +2204,343 @@ void Mpeg2Handler::ProcessTSPacket( unsigned char *packet )
 		   - 4 bytes header
 		   - 1 byte adaptation-length info
 		   - adaptation-length */
-		ProcessPayload( &packet[188 - 4 - 1 - packet[4]], pid, 188 - 4 - 1 - packet[4] );
+		ProcessPayload( &packet[4 + 1 + packet[4]], pid, 188 - 4 - 1 - packet[4] );
 	    break;
 	} /* switch */
 }
 
 
-int Mpeg2Handler::writeJVCP25( unsigned char *data, int len )
+/** Corrects the packets of a JVC 50 fps stream in place
+
+    \param data whole TS packets
+    \param len the number of bytes in data
+*/
+
+void Mpeg2Handler::CorrectJVCP25( unsigned char *data, int len )
+{
+	for ( int i = 0; i + HDV_PACKET_SIZE <= len; i += HDV_PACKET_SIZE )
+		if ( HDV_PACKET_MARKER == data[ i ] )
+			ProcessTSPacket( &data[ i ] );
+}
+
+
+/***************************************************************************/
+
+
+/// the samples in an MPEG audio layer II frame
+#define MPEG_AUDIO_FRAME_SAMPLES 1152
+
+/// a PTS further than this from where the picture is expected is a discontinuity
+#define MP4_MAX_PTS_JUMP 90000
+
+
+/** Gets the difference of two 33 bit time stamps, across a wrap */
+
+static long long PTSDifference( long long a, long long b )
 {
-	static unsigned char state = 0, ts_packet[188], rest_length;
-	int i;
-	unsigned char next_possible_start_position = 0;
-	
-	for ( i = 0; i < len; i++ )
+	return ( ( a - b + ( 1LL << 32 ) ) & ( ( 1LL << 33 ) - 1 ) ) - ( 1LL << 32 );
+}
+
+
+/** Reads the header of an MPEG-1 or MPEG-2 audio layer II frame
+
+    \param h the four bytes of the header
+    \param sampleRate set to the sample rate
+    \param channels set to the number of channels
+    \param objectType set to the MPEG-4 systems object type of the stream
+    \return the length of the frame in bytes, or 0 if h is no header
+*/
+
+static int ParseMPEGAudioHeader( const unsigned char *h, int &sampleRate, int &channels, int &objectType )
+{
+	static const int bitRates[ 2 ][ 16 ] =
+	    {
+	        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+	        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 }
+	    };
+	static const int sampleRates[ 4 ] = { 44100, 48000, 32000, 0 };
+
+	// sync word, MPEG-1 or MPEG-2, layer II
+	if ( h[ 0 ] != 0xff || ( h[ 1 ] & 0xf6 ) != 0xf4 )
+		return 0;
+
+	int lsf = !( h[ 1 ] & 0x08 );
+	int bitRate = bitRates[ lsf ][ h[ 2 ] >> 4 ];
+	sampleRate = sampleRates[ ( h[ 2 ] >> 2 ) & 3 ] >> lsf;
+	if ( bitRate == 0 || sampleRate == 0 )
+		return 0;
+	channels = ( h[ 3 ] >> 6 ) == 3 ? 1 : 2;
+	objectType = lsf ? MP4_OTI_MPEG2_AUDIO : MP4_OTI_MPEG1_AUDIO;
+	return 144000 * bitRate / sampleRate + ( ( h[ 2 ] >> 1 ) & 1 );
+}
+
+
+Mp4Handler::Mp4Handler() :
+	totalFrames( 0 ), isStarted( false ), isAudioStarted( false ), isAudioPESStarted( false ),
+	videoPID( 0 ), audioPID( 0 ),
+	picturePTS( -1 ), startPTS( -1 ), decodeTime( 0 ), audioPTS( -1 )
+{
+	extension = ".mp4";
+}
+
+Mp4Handler::~Mp4Handler()
+{
+	Close();
+}
+
+bool Mp4Handler::FileIsOpen()
+{
+	return file.IsOpen();
+}
+
+bool Mp4Handler::Create( const string& filename )
+{
+	// A fragmented file is never sought in, so it can go to a pipe
+	if ( GetBaseName() == "-" )
+		file.Attach( fileno( stdout ) );
+	else if ( !file.Create( filename ) )
+		return false;
+
+	FileTracker::GetInstance().Add( filename.c_str() );
+	this->filename = filename;
+	isStarted = false;
+	isAudioStarted = false;
+	isAudioPESStarted = false;
+	startPTS = -1;
+	decodeTime = 0;
+	audio.clear();
+	audioPTS = -1;
+	return true;
+}
+
+int Mp4Handler::Write( Frame *frame )
+{
+	if ( !frame->IsHDV() )
+		return -1;
+
+	HDVFrame *hdvFrame = static_cast< HDVFrame* >( frame );
+	videoPID = hdvFrame->GetVideoPID();
+	audioPID = hdvFrame->GetAudioPID();
+	picture.clear();
+	picturePTS = -1;
+
+	for ( int i = 0; i <= hdvFrame->GetHeadCount(); i++ )
+	{
+		int length = frame->GetDataLen();
+		unsigned char *data = i < hdvFrame->GetHeadCount() ? hdvFrame->GetHead( i, length ) : frame->data;
+
+		for ( int j = 0; j + HDV_PACKET_SIZE <= length; j += HDV_PACKET_SIZE )
+			if ( HDV_PACKET_MARKER == data[ j ] )
+				ProcessPacket( &data[ j ] );
+	}
+
+	if ( hdvFrame->IsGOP() )
 	{
-		switch (state)
+		if ( !isStarted && !picture.empty() )
+			isStarted = Start( hdvFrame );
+		else if ( file.HasSamples() && !file.WriteFragment() )
+			return -1;
+	}
+	if ( !isStarted || picture.empty() )
+		return 0;
+
+	AddPicture( hdvFrame );
+	AddAudioFrames();
+	totalFrames++;
+	return picture.size();
+}
+
+/** Takes the elementary stream data out of a TS packet
+
+    The payload of the video PID is collected in picture without the
+    PES header, that of the audio PID is added to audio.
+*/
+
+void Mp4Handler::ProcessPacket( unsigned char *packet )
+{
+	unsigned int pid = ( ( packet[ 1 ] & 0x1f ) << 8 ) | packet[ 2 ];
+	bool isStart = packet[ 1 ] & 0x40;
+	unsigned char *payload;
+	int length;
+	long long pts = -1;
+
+	if ( pid == 0 || ( pid != ( unsigned int ) videoPID && pid != ( unsigned int ) audioPID ) )
+		return;
+	if ( !( payload = GetTSPayload( packet, length ) ) )
+		return;
+	if ( isStart && !( payload = SkipPESHeader( payload, length, pts ) ) )
+		return;
+
+	if ( pid == ( unsigned int ) videoPID )
+	{
+		if ( isStart && picturePTS == -1 )
+			picturePTS = pts;
+		picture.insert( picture.end(), payload, payload + length );
+	}
+	else
+	{
+		// Until the audio is placed on the time line, the buffer
+		// starts with a PES packet so its PTS is known. The rest of a
+		// PES packet begun before the file started is dropped.
+		if ( !isAudioStarted )
 		{
-		/* seek for HDV_PACKET_MARKER of transport packet */
-		case 0:
-			if ( HDV_PACKET_MARKER == data[i] )
+			if ( isStart )
 			{
-				ts_packet[0] = data[i];
-				rest_length = 187;
-				state = 1;
+				audio.clear();
+				audioPTS = pts;
+				isAudioPESStarted = true;
 			}
+			else if ( !isAudioPESStarted )
+			{
+				return;
+			}
+		}
+		audio.insert( audio.end(), payload, payload + length );
+	}
+}
+
+/** Sets the video format of the file from the first GOP
+
+    \return false if the frame has no sequence header
+*/
+
+bool Mp4Handler::Start( HDVFrame *frame )
+{
+	int length = picture.size();
+	int start = -1;
+	int end = length;
+
+	// The sequence header and its extensions, up to the GOP header
+	for ( int i = FindStartCodePrefix( &picture[ 0 ], 0, length ); i + 3 < length;
+	        i = FindStartCodePrefix( &picture[ 0 ], i + 3, length ) )
+	{
+		if ( picture[ i + 3 ] == SEQUENCE_HEADER_CODE_VALUE )
+			start = i;
+		else if ( start != -1 && picture[ i + 3 ] != EXTENSION_START_CODE_VALUE )
+		{
+			end = i;
 			break;
+		}
+	}
+	if ( start == -1 || frame->GetWidth() <= 0 || frame->GetHeight() <= 0 )
+		return false;
 
-		case 1:
-			if (0 < rest_length)
+	// HDV is 16:9
+	int hSpacing = 16 * frame->GetHeight();
+	int vSpacing = 9 * frame->GetWidth();
+	int a = hSpacing;
+	int b = vSpacing;
+	while ( b )
+	{
+		int c = a % b;
+		a = b;
+		b = c;
+	}
+	hSpacing /= a;
+	vSpacing /= a;
+
+	file.SetVideoFormat( frame->GetWidth(), frame->GetHeight(), hSpacing, vSpacing, &picture[ start ], end - start );
+	startPTS = picturePTS;
+	return true;
+}
+
+/** Adds the picture of the frame to the file
+
+    The decode times of the pictures follow from the frame rate. The
+    composition offset puts each picture where its PTS says, relative
+    to the first picture of the file.
+*/
+
+void Mp4Handler::AddPicture( HDVFrame *frame )
+{
+	int duration = frame->GetFrameRate() > 0 ? ( int ) ( 90000 / frame->GetFrameRate() + 0.5 ) : 3600;
+	int offset = 0;
+
+	if ( picturePTS != -1 && startPTS != -1 )
+	{
+		long long difference = PTSDifference( picturePTS, startPTS ) - decodeTime;
+		if ( difference < -MP4_MAX_PTS_JUMP || difference > MP4_MAX_PTS_JUMP )
+			startPTS = PTSDifference( picturePTS, decodeTime ) & ( ( 1LL << 33 ) - 1 );
+		else
+			offset = difference;
+	}
+	else if ( picturePTS != -1 )
+	{
+		startPTS = PTSDifference( picturePTS, decodeTime ) & ( ( 1LL << 33 ) - 1 );
+	}
+
+	file.AddVideoSample( &picture[ 0 ], picture.size(), duration, offset, frame->GetPictureType() == 1 );
+	decodeTime += duration;
+}
+
+/** Adds the complete audio frames collected so far to the file
+
+    The first frame is placed on the time line by its PTS. Frames
+    before the first picture are dropped.
+*/
+
+void Mp4Handler::AddAudioFrames()
+{
+	unsigned int i = 0;
+
+	while ( i + 4 <= audio.size() )
+	{
+		int sampleRate, channels, objectType;
+		int length = ParseMPEGAudioHeader( &audio[ i ], sampleRate, channels, objectType );
+
+		if ( length == 0 )
+		{
+			// lost sync
+			i++;
+			continue;
+		}
+		if ( i + length > audio.size() )
+			break;
+		if ( !isAudioStarted )
+		{
+			long long start = audioPTS != -1 && startPTS != -1 ? PTSDifference( audioPTS, startPTS ) : 0;
+			if ( start < 0 )
 			{
-				ts_packet[ 188 - rest_length ] = data[i];
-				rest_length--;
-				if ( ! next_possible_start_position )
-				if ( HDV_PACKET_MARKER == data[i] )
-					next_possible_start_position = i;
+				audioPTS += MPEG_AUDIO_FRAME_SAMPLES * 90000 / sampleRate;
+				i += length;
+				continue;
 			}
-			else 
-			{
-				/* 188 byte seen */
-				if ( HDV_PACKET_MARKER == data[i] )
-				{
-					/* last 188 bytes were ts packet */
-					ProcessTSPacket( ts_packet );
-					writen( fd, ts_packet, 188 );
-					ts_packet[0] = data[i];
-					rest_length = 187;
-				}
-				else
-				{
-					/* last 188 bytes are not a ts packet */
-					/* scan again beginning with the next possible start of ts_packet */
-					state = 0;
-					/* write unchanged first bytes up to next_possible_start_position */
-					writen( fd, ts_packet, next_possible_start_position + 1 );
-					writeJVCP25( &ts_packet[ next_possible_start_position ],
-						188 - next_possible_start_position);
-					ts_packet[ 188 - rest_length ] = data[i];
-				} /* if */
-			} /* if */
-			break;
+			file.SetAudioFormat( objectType, sampleRate, channels );
+			file.SetAudioDecodeTime( start * sampleRate / 90000 );
+			isAudioStarted = true;
+		}
+		file.AddAudioSample( &audio[ i ], length, MPEG_AUDIO_FRAME_SAMPLES );
+		i += length;
+	}
+	audio.erase( audio.begin(), audio.begin() + i );
+}
 
-		default:
-			return -1; /* undefined state */
-		} /* switch */
-    } /* for */
-    return 0;
+int Mp4Handler::Close()
+{
+	if ( file.IsOpen() && !file.Close() )
+	{
+		sendEvent( ">>> Error writing the last MP4 fragment" );
+		return -1;
+	}
+	return 0;
+}
+
+off_t Mp4Handler::GetFileSize()
+{
+	return file.GetFileSize();
+}
+
+int Mp4Handler::GetTotalFrames()
+{
+	return totalFrames;
+}
+
+bool Mp4Handler::Open( const char *s )
+{
+	return false;
+}
+
+int Mp4Handler::GetFrame( Frame *frame, int frameNum )
+{
+	return -1;
 }
@@ -22,7 +22,7 @@
 #ifndef _FILEHANDLER_H
 #define _FILEHANDLER_H
 
-enum { PAL_FORMAT, NTSC_FORMAT, AVI_DV1_FORMAT, AVI_DV2_FORMAT, QT_FORMAT, RAW_FORMAT, DIF_FORMAT, JPEG_FORMAT, MPEG2TS_FORMAT, UNDEFINED };
+enum { PAL_FORMAT, NTSC_FORMAT, AVI_DV1_FORMAT, AVI_DV2_FORMAT, QT_FORMAT, RAW_FORMAT, DIF_FORMAT, JPEG_FORMAT, MPEG2TS_FORMAT, THUMB_FORMAT, MP4_FORMAT, UNDEFINED };
 
 #include <vector>
 using std::vector;
@@ -34,13 +34,13 @@ using std::string;
 #include "hdvframe.h"
 #include "riff.h"
 #include "avi.h"
+#include "scene.h"
+#include "gopindex.h"
+#include "mp4.h"
+#include "audiodemux.h"
+#include "pidfilter.h"
 #include <sys/types.h>
-
-/* this is a struct for each available pid */
-typedef struct PayloadList {
-	unsigned char	pid, state;
-	struct PayloadList	*next;
-} PayloadList;
+#include <sys/uio.h>
 
 enum FileCaptureMode {
 	CAPTURE_IGNORE,
@@ -77,6 +77,7 @@ public:
 
 	virtual bool GetAutoSplit();
 	virtual int  GetTimeSplit();
+	virtual int  GetSceneSplit();
 	virtual bool GetTimeStamp();
 	virtual bool GetTimeSys();
 	virtual bool GetTimeCode();
@@ -93,6 +94,7 @@ public:
 
 	virtual void SetAutoSplit( bool );
 	virtual void SetTimeSplit(int secs);
+	virtual void SetSceneSplit( int threshold );
 	virtual void SetTimeStamp( bool );
 	virtual void SetTimeSys( bool );
 	virtual void SetTimeCode( bool );
@@ -146,6 +148,7 @@ protected:
 	bool done;
 	bool autoSplit;
 	int  timeSplit;
+	SceneDetector sceneDetector;
 	bool timeStamp;
 	bool timeSys;
 	bool timeCode;
@@ -187,6 +190,14 @@ public:
 	int GetFrame( Frame *frame, int frameNum );
 private:
 	int numBlocks;
+
+	/// a range of the source file not yet copied to the output
+	int copyFd;
+	int copySource;
+	off_t copyOffset;
+	off_t copyLength;
+
+	int FlushCopy();
 };
 
 
@@ -207,6 +218,7 @@ public:
 	int GetFrame( Frame *frame, int frameNum );
 	bool GetOpenDML();
 	void SetOpenDML( bool );
+	void SetCheckpoint( int secs );
 
 protected:
 	const string *filen;
@@ -218,6 +230,8 @@ protected:
 	bool	isOpenDML;
 	DVINFO dvinfo;
 	FOURCC fccHandler;
+	int checkpoint;
+	int framesSinceCheckpoint;
 };
 
 #ifdef HAVE_LIBQUICKTIME
@@ -247,29 +261,162 @@ private:
 	bool isFullyInitialized;
 
 	unsigned int audioBufferSize;
-	int16_t *audioBuffer;
-	short int** audioChannelBuffer;
-	short int* audioChannelBuffers[ 4 ];
+	int16_t *audioChannelBuffers[ 4 ];
 
 	void Init();
-	inline void DeinterlaceStereo16( void* pInput, int iBytes, void* pLOutput, void* pROutput );
 
 };
 #endif
 
 
-#if defined(HAVE_LIBJPEG) && defined(HAVE_LIBDV)
+#ifdef HAVE_LIBJPEG
 extern "C"
 {
 #include <jpeglib.h>
 }
 
-class JPEGHandler: public FileHandler
+/** Writes contact sheets of thumbnails made from DC coefficients
+
+    A thumbnail is taken at the start of each file and recording, and
+    every so many frames in between. It costs no DV decoding, so this
+    runs many times faster than real time.
+*/
+
+class ThumbHandler: public FileHandler
 {
 private:
 	struct jpeg_error_mgr jerr;
 	struct jpeg_compress_struct cinfo;
-	JSAMPLE image_buffer[ 2048*2048*3 ];
+	bool isOpen;
+	string filename;
+	string file;
+	unsigned int count;
+	int every;
+	int columns;
+	int rows;
+	/// frames since the last thumbnail, -1 until the first one of the file
+	int framesSinceThumb;
+	/// thumbnails on the current sheet, and their height
+	int thumbs;
+	int thumbHeight;
+	unsigned char dc[ DV_DC_WIDTH * DV_DC_HEIGHT * 3 ];
+	JSAMPLE *sheet;
+	JSAMPLE lumaRange[ 256 ];
+	JSAMPLE chromaRange[ 256 ];
+
+	void WriteSheet();
+
+public:
+	ThumbHandler( int quality, int every = 0, int columns = 8, int rows = 8 );
+	~ThumbHandler();
+
+	bool FileIsOpen()
+	{
+		return isOpen;
+	}
+	bool Create( const string& filename );
+	int Write( Frame *frame );
+	int Close();
+	off_t GetFileSize()
+	{
+		return 0;
+	}
+	int GetTotalFrames()
+	{
+		return 0;
+	}
+	bool Open( const char *s )
+	{
+		return false;
+	}
+	string GetFileName()
+	{
+		return file;
+	}
+	int GetFrame( Frame *frame, int frameNum )
+	{
+		return -1;
+	}
+};
+#endif
+
+
+#if defined(HAVE_LIBJPEG) && defined(HAVE_LIBDV)
+class JPEGHandler;
+
+/** A frame waiting to be turned into a JPEG file
+
+    The frame data is copied so the capture thread can reuse its
+    buffer right away. Each job has its own DVFrame, and with it its
+    own libdv decoder.
+*/
+
+class JPEGJob
+{
+public:
+	DVFrame frame;
+	string file;
+	unsigned int sequence;
+};
+
+
+/** One thread of the JPEG encoder pool
+
+    Everything a frame needs on its way from DV to JPEG is owned by a
+    single worker: the compressor, the image buffers and the memory
+    the compressed image is collected in.
+*/
+
+class JPEGWorker
+{
+public:
+	JPEGWorker( JPEGHandler *handler, int quality );
+	~JPEGWorker();
+
+	void Encode( JPEGJob *job );
+
+	JPEGHandler *handler;
+	pthread_t thread;
+
+	/// the compressed image of the last encoded job
+	JOCTET *output;
+	size_t outputSize;
+
+private:
+	struct jpeg_error_mgr jerr;
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_destination_mgr dest;
+	/// the decoded frame in YUY2
+	JSAMPLE *image_buffer;
+	/// the Y, Cb and Cr planes of the frame, and of the scaled frame
+	JSAMPLE *planes[ 3 ];
+	JSAMPLE *scaled[ 3 ];
+	/// maps video range samples to full range
+	JSAMPLE lumaRange[ 256 ];
+	JSAMPLE chromaRange[ 256 ];
+	size_t outputCapacity;
+	/// the resampling filters of the last scaled plane, and one line of it
+	vector< int > rowIndex;
+	vector< int > rowWeights;
+	vector< int > columnIndex;
+	vector< int > columnWeights;
+	vector< int > rowBuffer;
+
+	void Unpack( int width, int height, int vsamp );
+	void scale( const JSAMPLE *image, int width, int height, int stride,
+	            JSAMPLE *dest, int new_width, int new_height, int new_stride );
+
+	static void InitDestination( j_compress_ptr cinfo );
+	static boolean EmptyOutputBuffer( j_compress_ptr cinfo );
+	static void TermDestination( j_compress_ptr cinfo );
+};
+
+
+class JPEGHandler: public FileHandler
+{
+	friend class JPEGWorker;
+
+private:
 	bool isOpen;
 	string filename;
 	unsigned int count;
@@ -280,12 +427,28 @@ private:
 	string file;
 	string temp;
 	bool usetemp;
-
-	int fixAspect( Frame *frame );
-	bool scale( Frame *frame );
+	bool preview;
+
+	/// the encoder threads, and the jobs free to be filled by Write
+	vector< JPEGWorker* > workers;
+	vector< JPEGJob* > jobs;
+	deque< JPEGJob* > freeJobs;
+	/// jobs waiting for a worker, oldest first
+	deque< JPEGJob* > queue;
+	/// the sequence number of the next job written and of the next one to be committed
+	unsigned int nextSequence;
+	unsigned int nextCommit;
+	bool stopping;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t jobQueued;
+	pthread_cond_t jobDone;
+
+	static void *WorkerThread( void *arg );
+	void Commit( JPEGWorker *worker, JPEGJob *job );
 
 public:
-	JPEGHandler( int quality, bool deinterlace = false, int width = -1, int height = -1, bool overwrite = false, string temp = "tmp.jpg", bool usetemp = false );
+	JPEGHandler( int quality, bool deinterlace = false, int width = -1, int height = -1, bool overwrite = false, string temp = "tmp.jpg", bool usetemp = false, int threads = 1, bool preview = false );
 	~JPEGHandler();
 
 	bool FileIsOpen()
@@ -326,6 +489,7 @@ public:
 	Mpeg2Handler( unsigned char flags, const string& ext = string( ".m2t" ) );
 	~Mpeg2Handler();
 
+	void SetPIDFilter( const PIDFilter &filter );
 	bool WriteFrame( Frame *frame );
 	bool FileIsOpen();
 	bool Create( const string& filename );
@@ -339,14 +503,74 @@ public:
 private:
 	void ProcessPayload( unsigned char *packet, unsigned int pid, unsigned char len );
 	void ProcessTSPacket( unsigned char *packet );
-	int writeJVCP25( unsigned char *data, int len );
+	void CorrectJVCP25( unsigned char *data, int len );
+	void addSpan( unsigned char *data, int len );
+	void addPackets( unsigned char *data, int len, int audioPID );
 #define MPEG2_BUFFER_SIZE (2*1024*1024)
 	bool waitingForRecordingDate;
 	unsigned char buffer[MPEG2_BUFFER_SIZE];
 	int bufferLen;
 	int totalFrames;
 	const unsigned char writerFlags;
-	PayloadList *firstPayloadEntry;
+	// the JVC P25 correction state of every PID
+	unsigned char p25State[ 0x2000 ];
+	std::vector< struct iovec > spans;
+	// bytes written to the current file
+	off_t fileOffset;
+	GOPIndexWriter gopIndex;
+	// the GOPs in buffer, at offsets within it
+	std::vector< GOPIndexEntry > bufferedGOPs;
+	AudioDemuxer *audioDemuxer;
+	PIDFilter pidFilter;
+};
+
+/** Writes HDV as fragmented MP4 without re-encoding
+
+    The MPEG-2 pictures and the MPEG audio frames are taken from the
+    transport stream packets of the frames as they are, and each GOP
+    becomes a movie fragment. Frames before the first GOP of a file are
+    not written.
+*/
+
+class Mp4Handler: public FileHandler
+{
+public:
+	Mp4Handler();
+	~Mp4Handler();
+
+	bool FileIsOpen();
+	bool Create( const string& filename );
+	int Write( Frame *frame );
+	int Close();
+	off_t GetFileSize();
+	int GetTotalFrames();
+	bool Open( const char *s );
+	int GetFrame( Frame *frame, int frameNum );
+
+private:
+	void ProcessPacket( unsigned char *packet );
+	bool Start( HDVFrame *frame );
+	void AddPicture( HDVFrame *frame );
+	void AddAudioFrames();
+
+	MP4File file;
+	int totalFrames;
+	bool isStarted;
+	bool isAudioStarted;
+	// whether audio holds data from the start of a PES packet
+	bool isAudioPESStarted;
+	int videoPID;
+	int audioPID;
+	// the video elementary stream of the frame
+	std::vector< unsigned char > picture;
+	long long picturePTS;
+	// the PTS that is shown at time 0, less any discontinuity
+	long long startPTS;
+	// the decode time of the next picture, in 90 kHz units
+	long long decodeTime;
+	// audio elementary stream not yet split into frames
+	std::vector< unsigned char > audio;
+	long long audioPTS;
 };
 
 #endif
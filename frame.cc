@@ -19,7 +19,7 @@
 
 #include "frame.h"
 
-Frame::Frame()
+Frame::Frame( bool hdv ) : isHDV( hdv )
 {
 	Clear();
 }
@@ -28,22 +28,14 @@ Frame::~Frame()
 {
 }
 
-int Frame::GetDataLen()
-{
-	return dataLen;
-}
-
 void Frame::SetDataLen( int len )
 {
 	dataLen = len;
 }
 
-void Frame::AddDataLen( int len )
-{
-	SetDataLen( GetDataLen() + len );
-}
-
 void Frame::Clear()
 {
 	dataLen = 0;
+	sourceFd = -1;
+	sourceOffset = 0;
 }
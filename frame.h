@@ -45,6 +45,7 @@ using std::endl;
 #include <pthread.h>
 #include <stdio.h>
 #include <time.h>
+#include <sys/types.h>
 
 #define TIMECODE_TO_SEC( tc ) (((((tc).hour * 60) + (tc).min) * 60) + (tc).sec)
 
@@ -64,16 +65,26 @@ class Frame
 {
 public:
 	unsigned char data[ DATA_BUFFER_LEN ];
+
+	/// the file the data was read from, or -1 if it did not come from a file
+	int sourceFd;
+	/// the position of the data in sourceFd
+	off_t sourceOffset;
+
 private:
 	int dataLen;
+	bool isHDV;
 
 public:
-	Frame();
+	Frame( bool hdv = false );
 	virtual ~Frame();
 
-	virtual int GetDataLen( void );
+	// These are called for every packet received, so only what
+	// differs between DV and HDV is virtual. AddDataLen() only appends,
+	// the readers of HDV then call HDVFrame::ParseData().
+	int GetDataLen( void ) { return dataLen; }
 	virtual void SetDataLen( int len );
-	virtual void AddDataLen( int len );
+	void AddDataLen( int len ) { dataLen += len; }
 	virtual void Clear( void );
 
 	// Meta-data
@@ -88,7 +99,7 @@ public:
 	virtual float GetFrameRate() { return -1; }
 
 	// HDV vs DV
-	virtual bool IsHDV() { return false; }
+	bool IsHDV() { return isHDV; }
 	virtual bool CouldBeJVCP25() { return false; }
 
 	// For HDV only GOP packets can start a new stream/file
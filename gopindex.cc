@@ -0,0 +1,117 @@
+/*
+* gopindex.cc -- Index of the GOPs in an HDV file
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#include <endian.h>
+
+#include "gopindex.h"
+#include "stringutils.h"
+
+/// the entries written at a time; the rest of the index is lost if the capture is killed
+#define GOP_INDEX_FLUSH 16
+
+
+GOPIndexEntry::GOPIndexEntry() :
+		offset( 0 ), pts( htole64( ( uint64_t ) -1 ) ), recordingDate( htole64( ( uint64_t ) -1 ) ), flags( 0 )
+{
+	memset( timeCode, 0xff, sizeof( timeCode ) );
+}
+
+
+/** Makes the entry of a GOP
+
+    \param offset the position of the frame in the video file
+    \param frame the first frame of the GOP
+*/
+
+GOPIndexEntry::GOPIndexEntry( off_t offset, HDVFrame &frame )
+{
+	TimeCode tc;
+	struct tm rd;
+
+	this->offset = htole64( offset );
+	pts = htole64( frame.GetPTS() );
+	if ( frame.GetRecordingDate( rd ) )
+		recordingDate = htole64( timegm( &rd ) );
+	else
+		recordingDate = htole64( ( uint64_t ) -1 );
+	if ( frame.GetTimeCode( tc ) )
+	{
+		timeCode[ 0 ] = tc.hour;
+		timeCode[ 1 ] = tc.min;
+		timeCode[ 2 ] = tc.sec;
+		timeCode[ 3 ] = tc.frame;
+	}
+	else
+	{
+		memset( timeCode, 0xff, sizeof( timeCode ) );
+	}
+	flags = htole32( frame.IsNewRecording() ? GOP_INDEX_NEW_RECORDING : 0 );
+}
+
+
+GOPIndexWriter::GOPIndexWriter() : entries( 0 )
+{}
+
+
+GOPIndexWriter::~GOPIndexWriter()
+{
+	Close();
+}
+
+
+/** Starts the index of a video file
+
+    \param videoName the video file
+*/
+
+void GOPIndexWriter::Open( const std::string &videoName )
+{
+	Close();
+	os.clear();
+	os.open( StringUtils::replaceExtension( videoName, ".gop" ).c_str(), std::ios::binary );
+
+	uint32_t header[ 2 ] = { htole32( GOP_INDEX_VERSION ), htole32( sizeof( GOPIndexEntry ) ) };
+	os.write( GOP_INDEX_MAGIC, 8 );
+	os.write( ( const char* ) header, sizeof( header ) );
+	os.flush();
+	entries = 0;
+}
+
+
+void GOPIndexWriter::Close()
+{
+	if ( os.is_open() )
+		os.close();
+}
+
+
+void GOPIndexWriter::Add( const GOPIndexEntry &entry )
+{
+	if ( !os.is_open() )
+		return;
+	os.write( ( const char* ) &entry, sizeof( entry ) );
+	if ( ++entries % GOP_INDEX_FLUSH == 0 )
+		os.flush();
+}
@@ -0,0 +1,80 @@
+/*
+* gopindex.h -- Index of the GOPs in an HDV file
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DVGRAB_GOPINDEX_H
+#define DVGRAB_GOPINDEX_H
+
+#include <fstream>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "hdvframe.h"
+
+#define GOP_INDEX_MAGIC "DVGRABGI"
+#define GOP_INDEX_VERSION 1
+
+/// the entry has a recording date that starts a new recording
+#define GOP_INDEX_NEW_RECORDING (1<<0)
+
+/** An entry of a GOP index, as stored in the file
+
+    All fields are little endian. A field that is not known is -1, or
+    0xff for the bytes of the timecode.
+*/
+
+struct GOPIndexEntry
+{
+	/// of the first packet of the GOP in the video file
+	uint64_t offset;
+	/// of the first picture, in 90 kHz units
+	int64_t pts;
+	/// the recording date and time, in seconds since 1970 as if it were UTC
+	int64_t recordingDate;
+	/// hours, minutes, seconds, frames
+	uint8_t timeCode[ 4 ];
+	uint32_t flags;
+
+	GOPIndexEntry();
+	GOPIndexEntry( off_t offset, HDVFrame &frame );
+};
+
+/** Lists the GOPs of an HDV file next to it
+
+    The index of foo-001.m2t is foo-001.gop. It starts with the 8 bytes
+    of GOP_INDEX_MAGIC, the version and the size of an entry as 32 bit
+    little endian numbers, followed by a GOPIndexEntry for every GOP in
+    the order of the file.
+*/
+
+class GOPIndexWriter
+{
+	std::ofstream os;
+	int entries;
+
+public:
+	GOPIndexWriter();
+	~GOPIndexWriter();
+
+	void Open( const std::string &videoName );
+	void Close();
+	void Add( const GOPIndexEntry &entry );
+};
+
+#endif
@@ -0,0 +1,232 @@
+/*
+* hdvbench.cc -- time the parsing of HDV transport streams
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/** Times the MPEG-2 parser on an HDV file
+
+    The file is read into memory and parsed several times, the best
+    run counting. Two things are timed: the bit reader alone, reading
+    the fields of the TS packet headers, and the whole parser, with
+    the packets added to frames one at a time as the FireWire reader
+    does. One line of tab separated key=value pairs is printed for
+    each.
+
+    \file hdvbench.cc
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <vector>
+#include <deque>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::deque;
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "hdvframe.h"
+
+/// frames the parser may hold on to, as the capture queue does
+#define BENCH_FRAMES 16
+/// frames handed on before the oldest is given back
+#define BENCH_LAG 3
+
+static double Now()
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/** Reads every field of the TS packet headers
+
+    \param data whole TS packets
+    \param length the bytes of data
+    \param fields gets the number of fields read
+    \return a sum of the fields, so they are not optimised away
+*/
+
+static unsigned long ReadFields( const unsigned char *data, size_t length, long &fields )
+{
+	// sync_byte, transport_error_indicator, payload_unit_start_indicator,
+	// transport_priority, PID, transport_scrambling_control,
+	// adaptation_field_control, continuity_counter
+	static const int layout[][ 2 ] = { { 0, 8 }, { 8, 1 }, { 9, 1 }, { 10, 1 }, { 11, 13 }, { 24, 2 }, { 26, 2 }, { 28, 4 } };
+	const int n = sizeof( layout ) / sizeof( layout[ 0 ] );
+	unsigned long sum = 0;
+
+	fields = 0;
+	for ( size_t i = 0; i + HDV_PACKET_SIZE <= length; i += HDV_PACKET_SIZE )
+	{
+		BitReader reader( data + i, HDV_PACKET_SIZE );
+		for ( int j = 0; j < n; j++ )
+			sum += reader.GetBits( layout[ j ][ 0 ], layout[ j ][ 1 ] );
+		fields += n;
+	}
+	return sum;
+}
+
+
+/** Parses the packets into frames
+
+    \param data whole TS packets
+    \param length the bytes of data
+    \param frames gets the number of frames completed
+    \return a sum of the parsed picture sizes, so they are not optimised away
+*/
+
+static unsigned long ParseFrames( unsigned char *data, size_t length, long &frames )
+{
+	HDVStreamParams params;
+	deque< Frame* > unused;
+	deque< HDVFrame* > done;
+	HDVFrame *frame = NULL;
+	unsigned long sum = 0;
+
+	for ( int i = 0; i < BENCH_FRAMES; i++ )
+		unused.push_back( new HDVFrame( &params ) );
+
+	frames = 0;
+	for ( size_t i = 0; i + HDV_PACKET_SIZE <= length; i += HDV_PACKET_SIZE )
+	{
+		if ( frame == NULL )
+		{
+			if ( unused.empty() )
+			{
+				cerr << "hdvbench: out of frames" << endl;
+				exit( 1 );
+			}
+			frame = static_cast< HDVFrame* >( unused.front() );
+			unused.pop_front();
+			frame->Clear();
+		}
+		memcpy( &frame->data[ frame->GetDataLen() ], data + i, HDV_PACKET_SIZE );
+		frame->AddDataLen( HDV_PACKET_SIZE );
+		frame->ParseData();
+		if ( frame->IsComplete() )
+		{
+			sum += frame->GetPictureSize() + frame->GetPictureType();
+			done.push_back( frame );
+			frame = NULL;
+			frames++;
+		}
+		// A frame refers to the packets the next one has taken over
+		while ( done.size() > BENCH_LAG )
+		{
+			done.front()->Release( unused );
+			done.pop_front();
+		}
+	}
+
+	while ( !done.empty() )
+	{
+		done.front()->Release( unused );
+		done.pop_front();
+	}
+	if ( frame )
+		frame->Release( unused );
+	params.ReleaseCarryover( unused );
+	for ( unsigned int i = 0; i < unused.size(); i++ )
+		delete unused[ i ];
+	return sum;
+}
+
+
+static void Usage()
+{
+	cerr << "Usage: hdvbench [-n repetitions] file.m2t" << endl;
+	exit( 1 );
+}
+
+
+int main( int argc, char *argv[] )
+{
+	int repetitions = 5;
+	const char *name = NULL;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( strcmp( argv[ i ], "-n" ) == 0 && i + 1 < argc )
+			repetitions = atoi( argv[ ++i ] );
+		else if ( argv[ i ][ 0 ] != '-' && name == NULL )
+			name = argv[ i ];
+		else
+			Usage();
+	}
+	if ( name == NULL || repetitions < 1 )
+		Usage();
+
+	FILE *file = fopen( name, "rb" );
+	if ( file == NULL )
+	{
+		perror( name );
+		return 1;
+	}
+	vector< unsigned char > data;
+	unsigned char buffer[ 65536 ];
+	size_t n;
+	while ( ( n = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+		data.insert( data.end(), buffer, buffer + n );
+	fclose( file );
+	data.resize( data.size() / HDV_PACKET_SIZE * HDV_PACKET_SIZE );
+	if ( data.empty() )
+	{
+		cerr << "hdvbench: " << name << " holds no TS packets" << endl;
+		return 1;
+	}
+
+	double fieldTime = 1e9, parseTime = 1e9;
+	long fields = 0, frames = 0;
+	unsigned long sum = 0;
+
+	for ( int i = 0; i < repetitions; i++ )
+	{
+		double start = Now();
+		sum += ReadFields( &data[ 0 ], data.size(), fields );
+		double t = Now() - start;
+		if ( t < fieldTime )
+			fieldTime = t;
+
+		start = Now();
+		sum += ParseFrames( &data[ 0 ], data.size(), frames );
+		t = Now() - start;
+		if ( t < parseTime )
+			parseTime = t;
+	}
+
+	cout.setf( std::ios::fixed );
+	cout.precision( 2 );
+	cout << "test=bitreader\tfields=" << fields
+	     << "\tns_per_field=" << fieldTime * 1e9 / fields << endl;
+	cout << "test=parser\tframes=" << frames
+	     << "\tus_per_frame=" << ( frames ? parseTime * 1e6 / frames : 0 )
+	     << "\tMB_per_s=" << data.size() / parseTime / 1e6
+	     << "\tchecksum=" << sum << endl;
+	return 0;
+}
@@ -21,23 +21,16 @@
 #include <string.h>
 #include "hdvframe.h"
 
-HDVFrame::HDVFrame( HDVStreamParams *p )
+HDVFrame::HDVFrame( HDVStreamParams *p ) : Frame( true )
 {
 	Clear();
 
 	params = p;
-
-	packet = new HDVPacket( this, params );
+	packet = &params->packet;
 }
 
 HDVFrame::~HDVFrame()
 {
-	delete packet;
-}
-
-bool HDVFrame::IsHDV()
-{
-	return true;
 }
 
 bool HDVFrame::CouldBeJVCP25()
@@ -60,33 +53,111 @@ void HDVFrame::Clear()
 	width = 0;
 	height = 0;
 	frameRate = 0;
+	pictureType = -1;
+	pictureSize = 0;
+	quantiser = 0;
+	pts = -1;
 	repeatFirstField = false;
+	head.clear();
+	headLength = 0;
+	references = 1;
+	position = 0;
 	lastVideoDataLen = 0;
 	lastAudioDataLen = 0;
+	parsedLen = 0;
 
 	Frame::Clear();
 }
 
 void HDVFrame::SetDataLen( int len )
 {
-	int old_len = GetDataLen();
+	Frame::SetDataLen( len );
+	ParseData();
+}
+
+
+/** Parses the packets added since the last call
+
+    The readers add the packets with AddDataLen(), which is not
+    virtual, and call this after each.
+*/
+
+void HDVFrame::ParseData()
+{
+	int old_len = parsedLen;
+	int len = GetDataLen();
 
 	if ( !old_len )
 	{
-		if ( params->carryover_length > 0 )
-		{
-			memmove( &data[ params->carryover_length ], data, len );
-			memcpy( data, params->carryover_data, params->carryover_length );
-			len += params->carryover_length;
-			params->carryover_length = 0;
-		}
+		// Take over the packets the last frame has left for this one
+		head.swap( params->carryover );
+		for ( unsigned int i = 0; i < head.size(); i++ )
+			headLength += head[ i ].length;
 
 		DEBUG_RAW( d_hdv_video, "->\n<- New HDVFrame:" );
+
+		for ( unsigned int i = 0, start = 0; i < head.size() && !IsComplete(); start += head[ i++ ].length )
+			ProcessFrame( head[ i ].data, head[ i ].length, start );
 	}
 
-	Frame::SetDataLen( len );
+	if ( !IsComplete() )
+		ProcessFrame( &data[ old_len ], len - old_len, headLength + old_len );
+	parsedLen = GetDataLen();
+}
+
+
+/** The number of spans of the head
+
+    A frame does not copy the packets an earlier frame has received for
+    it; these stay in the earlier frame, which is referenced until this
+    frame is released. Writing the frame means writing the head spans,
+    in order, followed by data.
+*/
+
+int HDVFrame::GetHeadCount()
+{
+	return head.size();
+}
+
+
+/** A span of the head
+
+    \param n the span, 0 to GetHeadCount() - 1
+    \param length set to the number of bytes of the span
+    \return the bytes of the span
+*/
+
+unsigned char *HDVFrame::GetHead( int n, int &length )
+{
+	length = head[ n ].length;
+	return head[ n ].data;
+}
+
+
+int HDVFrame::GetHeadLen()
+{
+	return headLength;
+}
 
-	ProcessFrame( old_len );
+
+/** Gives up the frame and the frames referenced by its head
+
+    The frame stays in use while a later frame refers to its last
+    packets.
+
+    \param unused receives the frames that are no longer in use
+*/
+
+void HDVFrame::Release( std::deque< Frame* > &unused )
+{
+	for ( unsigned int i = 0; i < head.size(); i++ )
+		if ( __sync_sub_and_fetch( &head[ i ].frame->references, 1 ) == 0 )
+			unused.push_back( head[ i ].frame );
+	head.clear();
+	headLength = 0;
+
+	if ( __sync_sub_and_fetch( &references, 1 ) == 0 )
+		unused.push_back( this );
 }
 
 bool HDVFrame::GetRecordingDate( struct tm &rd )
@@ -114,6 +185,36 @@ float HDVFrame::GetFrameRate()
 	return frameRate;
 }
 
+int HDVFrame::GetPictureType()
+{
+	return pictureType;
+}
+
+int HDVFrame::GetPictureSize()
+{
+	return pictureSize;
+}
+
+float HDVFrame::GetQuantiser()
+{
+	return quantiser;
+}
+
+long long HDVFrame::GetPTS()
+{
+	return pts;
+}
+
+int HDVFrame::GetVideoPID()
+{
+	return params->video_stream_PID;
+}
+
+int HDVFrame::GetAudioPID()
+{
+	return params->audio_stream_PID;
+}
+
 bool HDVFrame::IsNewRecording()
 {
 	return isNewRecording;
@@ -139,20 +240,31 @@ int HDVFrame::GetHeight()
 	return height;
 }
 
-void HDVFrame::ProcessFrame( unsigned int start )
+/** Parses the packets of a span of the frame
+
+    \param buffer the packets
+    \param length the number of bytes in buffer
+    \param start the position of buffer within the frame, head included
+*/
+
+void HDVFrame::ProcessFrame( unsigned char *buffer, int length, int start )
 {
-	for ( int i = start; i+HDV_PACKET_SIZE-1 < GetDataLen() && !IsComplete(); i += HDV_PACKET_SIZE )
+	for ( int i = 0; i+HDV_PACKET_SIZE-1 < length && !IsComplete(); i += HDV_PACKET_SIZE )
 	{
-		if ( i+HDV_PACKET_SIZE > DATA_BUFFER_LEN )
+		if ( start-headLength+i+HDV_PACKET_SIZE > DATA_BUFFER_LEN )
 		{
 			sendEvent( "\aERROR:HDV Frame out of buffer space, completing packet early" );
+			// The video parser refers to the packets of this frame, drop
+			// the rest of the picture
+			params->video.Clear();
 			isComplete = true;
 			return;
 		}
 
-		if ( HDV_PACKET_MARKER == data[i] )
+		position = start + i;
+		if ( HDV_PACKET_MARKER == buffer[i] )
 		{
-			packet->SetData( &data[i] );
+			packet->SetData( &buffer[i] );
 			ProcessPacket();
 		}
 		else
@@ -160,7 +272,7 @@ void HDVFrame::ProcessFrame( unsigned int start )
 			// The stream has to be synced on packet boundries.
 			// This could be changed to do in-code packet marker searching/syncing,
 			// but it doesn't do that right now.
-			sendEvent( "Invalid packet sync_byte 0x%02x!", data[i] );
+			sendEvent( "Invalid packet sync_byte 0x%02x!", buffer[i] );
 		}
 	}
 }
@@ -237,27 +349,43 @@ void HDVFrame::ProcessVideo()
 		// This carryover (probably) will not be needed if iec13818-2 slice macroblock parsing is added
 		// until then, once the iec13818-2 parser detects a new PES packet and completes this HDVFrame,
 		// all data since the last video or audio packet is carried over to the next HDVFrame.
+		// The data stays where it is, this frame is referenced until the next one is released.
 		int lastDataLen = lastAudioDataLen > lastVideoDataLen ? lastAudioDataLen : lastVideoDataLen;
-		params->carryover_length = GetDataLen() - lastDataLen;
-		if ( params->carryover_length > CARRYOVER_DATA_MAX_SIZE )
+		int spanStart = 0;
+
+		for ( unsigned int i = 0; i < head.size(); spanStart += head[ i++ ].length )
+		{
+			int skip = lastDataLen - spanStart;
+			if ( skip >= head[ i ].length )
+				continue;
+			if ( skip < 0 )
+				skip = 0;
+			HDVSpan span = { head[ i ].frame, head[ i ].data + skip, head[ i ].length - skip };
+			params->carryover.push_back( span );
+			__sync_add_and_fetch( &span.frame->references, 1 );
+			head[ i ].length = skip;
+			headLength -= span.length;
+		}
+		if ( lastDataLen < headLength + GetDataLen() )
 		{
-			sendEvent( "\aERROR: too much carryover data (%d bytes), DROPPING DATA!\n", params->carryover_length );
-			params->carryover_length = CARRYOVER_DATA_MAX_SIZE;
+			int skip = lastDataLen > headLength ? lastDataLen - headLength : 0;
+			HDVSpan span = { this, data + skip, GetDataLen() - skip };
+			params->carryover.push_back( span );
+			__sync_add_and_fetch( &references, 1 );
+			Frame::SetDataLen( skip );
 		}
-		memcpy( params->carryover_data, &data[lastDataLen], params->carryover_length );
-		Frame::SetDataLen( lastDataLen );
 
 		SetComplete();
 	}
 	else
 	{
-		lastVideoDataLen = GetDataLen();
+		lastVideoDataLen = position + HDV_PACKET_SIZE;
 	}
 }
 
 void HDVFrame::ProcessAudio()
 {
-	lastAudioDataLen = GetDataLen();
+	lastAudioDataLen = position + HDV_PACKET_SIZE;
 }
 
 void HDVFrame::ProcessSonyA1()
@@ -328,6 +456,11 @@ void HDVFrame::SetComplete()
 	width = params->width;
 	height = params->height;
 	frameRate = params->frameRate;
+	pictureType = v->picture_coding_type;
+	pictureSize = v->GetLength();
+	if ( v->quantiser_scale_count )
+		quantiser = ( float ) v->quantiser_scale_sum / v->quantiser_scale_count;
+	pts = v->GetPTS();
 	repeatFirstField = v->repeat_first_field;
 	isComplete = true;
 	v->Clear();
@@ -344,8 +477,8 @@ HDVStreamParams::HDVStreamParams() :
 	audio_stream_PID( 0 ),
 	sony_private_a0_PID( 0 ),
 	sony_private_a1_PID( 0 ),
+	packet( this ),
 	width( 0 ), height( 0 ), frameRate( 0 ),
-	carryover_length( 0 ),
 	isRecordingDateSet( false ),
 	isTimeCodeSet( false ),
 	isGOPTimeCodeSet( false )
@@ -355,3 +488,16 @@ HDVStreamParams::HDVStreamParams() :
 HDVStreamParams::~HDVStreamParams()
 {
 }
+
+/** Drops the packets waiting for the next frame
+
+    \param unused receives the frames that are no longer in use
+*/
+
+void HDVStreamParams::ReleaseCarryover( std::deque< Frame* > &unused )
+{
+	for ( unsigned int i = 0; i < carryover.size(); i++ )
+		if ( __sync_sub_and_fetch( &carryover[ i ].frame->references, 1 ) == 0 )
+			unused.push_back( carryover[ i ].frame );
+	carryover.clear();
+}
@@ -20,11 +20,30 @@
 #ifndef _HDVFRAME_H
 #define _HDVFRAME_H 1
 
+#include <vector>
+#include <deque>
+
 #include "frame.h"
 #include "iec13818-1.h"
 #include "iec13818-2.h"
 
 #define MPEG2_JVC_P25	(1<<0)
+#define MPEG2_GOP_INDEX	(1<<1)
+#define MPEG2_AUDIO	(1<<2)
+
+class HDVFrame;
+
+/** A run of TS packets inside the buffer of an HDVFrame
+
+    The frame is referenced for as long as the span is in use.
+*/
+
+struct HDVSpan
+{
+	HDVFrame *frame;
+	unsigned char *data;
+	int length;
+};
 
 class HDVStreamParams
 {
@@ -40,11 +59,16 @@ public:
 	unsigned short sony_private_a0_PID;
 	unsigned short sony_private_a1_PID;
 
+	// The parse state is kept here, once for the stream, so that a
+	// frame allocates nothing and parsing a packet touches the same
+	// memory whichever frame it is in
+	HDVPacket packet;
 	Video video;
 
-#define CARRYOVER_DATA_MAX_SIZE (4 * DATA_BUFFER_LEN)
-	unsigned char carryover_data[CARRYOVER_DATA_MAX_SIZE];
-	int carryover_length;
+	// The packets at the end of the last completed frame that
+	// belong to the next one
+	std::vector< HDVSpan > carryover;
+	void ReleaseCarryover( std::deque< Frame* > &unused );
 
 	int width, height;
 	float frameRate;
@@ -59,13 +83,22 @@ public:
 
 class HDVFrame : public Frame
 {
+	friend class HDVStreamParams;
+
 public:
 	HDVFrame( HDVStreamParams *p );
 	~HDVFrame();
 
 	void SetDataLen( int len );
+	void ParseData();
 	void Clear();
 
+	// The packets taken over from earlier frames, which come before data
+	int GetHeadCount();
+	unsigned char *GetHead( int n, int &length );
+	int GetHeadLen();
+	void Release( std::deque< Frame* > &unused );
+
 	// Meta-data
 	bool GetTimeCode( TimeCode &tc );
 	bool GetRecordingDate( struct tm &rd );
@@ -77,9 +110,14 @@ public:
 	int GetWidth();
 	int GetHeight();
 	float GetFrameRate();
+	int GetPictureType();	// 1 = I, 2 = P, 3 = B, -1 = unknown
+	int GetPictureSize();	// coded picture bytes
+	float GetQuantiser();	// mean quantiser_scale_code, 0 = unknown
+	long long GetPTS();	// 90 kHz, -1 = unknown
+	int GetVideoPID();	// 0 = unknown
+	int GetAudioPID();	// 0 = unknown
 
 	// HDV or DV
-	bool IsHDV();
 	bool CanStartNewStream();
 	bool CouldBeJVCP25();
 
@@ -88,7 +126,7 @@ public:
 	void SetComplete();
 
 protected:
-	void ProcessFrame( unsigned int start );
+	void ProcessFrame( unsigned char *buffer, int length, int start );
 	void ProcessPacket();
 	void ProcessPAT();
 	void ProcessPMT();
@@ -110,9 +148,21 @@ protected:
 	int width;
 	int height;
 	float frameRate;
+	int pictureType;
+	int pictureSize;
+	float quantiser;
+	long long pts;
+
+	std::vector< HDVSpan > head;
+	int headLength;
+	int references;
 
+	// Positions count from the start of the head
+	int position;
 	int lastVideoDataLen;
 	int lastAudioDataLen;
+	// the bytes of data ParseData() has seen
+	int parsedLen;
 
 	bool repeatFirstField;
 };
@@ -25,8 +25,9 @@ using std::string;
 #include "hdvframe.h"
 #include "iec13818-1.h"
 
-HDVPacket::HDVPacket( HDVFrame *f, HDVStreamParams *p ) :
-	frame( f ),
+HDVPacket::HDVPacket( HDVStreamParams *p ) :
+	data( 0 ),
+	packetPID( 0 ),
 	params( p )
 {
 }
@@ -39,7 +40,6 @@ unsigned char HDVPacket::sync_byte() { return GetBits( 0, 8 ); }
 bool HDVPacket::transport_error_indicator() { return GetBits( 8, 1 ); }
 bool HDVPacket::payload_unit_start_indicator() { return GetBits( 9, 1 ); }
 bool HDVPacket::transport_priority() { return GetBits( 10, 1 ); }
-unsigned short HDVPacket::pid() { return GetBits( 11, 13 ); }
 unsigned char HDVPacket::transport_scrambling_control() { return GetBits( 24, 2 ); }
 unsigned char HDVPacket::adaptation_field_control() { return GetBits( 26, 2 ); }
 unsigned char HDVPacket::continuity_counter() { return GetBits( 28, 4 ); }
@@ -145,6 +145,7 @@ int HDVPacket::PayloadLength()
 void HDVPacket::SetData( unsigned char *d )
 {
 	data = d;
+	packetPID = GetBits( 11, 13 );
 
 	if ( is_program_association_packet() )
 		pat.SetData( payload(), PayloadLength() );
@@ -481,27 +482,104 @@ PES::~PES()
 
 void PES::AddData( unsigned char *d, int l )
 {
-	if ( length + l < MAX_PES_SIZE )
+	Span span = { d, length, l };
+
+	spans.push_back( span );
+	length += l;
+}
+
+/** Finds the span that holds a byte of the PES packet
+
+    The parsers mostly read forward, so the span of the previous
+    lookup and the one after it are tried first.
+
+    \param pos a position in the PES packet, 0 <= pos < GetLength()
+    \return the index of the span
+*/
+
+int PES::FindSpan( int pos )
+{
+	int first = 0;
+	int last = spans.size() - 1;
+
+	if ( pos >= spans[ lastSpan ].position )
 	{
-		memcpy( &data[length], d, l );
-		length += l;
+		if ( pos < spans[ lastSpan ].position + spans[ lastSpan ].length )
+			return lastSpan;
+		first = lastSpan + 1;
+		if ( first <= last && pos < spans[ first ].position + spans[ first ].length )
+			return lastSpan = first;
 	}
-	else
+	while ( first < last )
 	{
-		printf("PES data overflow!\n");
+		int middle = ( first + last + 1 ) / 2;
+		if ( pos < spans[ middle ].position )
+			last = middle - 1;
+		else
+			first = middle;
 	}
+	return lastSpan = first;
 }
 
-unsigned char *PES::GetBuffer() { return data; }
-
 unsigned char PES::GetData( int pos )
 {
-	if ( pos < GetLength() )
-		return data[pos];
+	if ( pos >= 0 && pos < GetLength() )
+	{
+		const Span &span = spans[ FindSpan( pos ) ];
+		return span.data[ pos - span.position ];
+	}
 	else
 		return 0;
 }
 
+unsigned long PES::GetBits( int offset, int len )
+{
+	int pos = offset >> 3;
+	unsigned char bytes[ 8 ];
+
+	if ( pos >= 0 && pos < GetLength() )
+	{
+		const Span &span = spans[ FindSpan( pos ) ];
+		if ( pos + 8 <= span.position + span.length )
+			return BitReader( span.data + pos - span.position, 8 ).GetBits( offset & 7, len );
+	}
+
+	// the field crosses the end of a transport stream packet
+	for ( int i = 0; i < 8; i++ )
+		bytes[ i ] = GetData( pos + i );
+	return BitReader( bytes, 8 ).GetBits( offset & 7, len );
+}
+
+/** Finds the next start code prefix 00 00 01
+
+    \param pos the first position to look at
+    \param end the end of the data to look at, at most GetLength()
+    \return the position of the first prefix at or after pos, or else
+    the first position that could not be checked, never before pos
+*/
+
+int PES::FindStartCode( int pos, int end )
+{
+	int start = pos;
+
+	while ( pos + 2 < end )
+	{
+		const Span &span = spans[ FindSpan( pos ) ];
+		int spanEnd = span.position + span.length < end ? span.position + span.length : end;
+		int found = span.position + FindStartCodePrefix( span.data, pos - span.position, spanEnd - span.position );
+
+		if ( found + 2 < spanEnd )
+			return found;
+
+		// a prefix that continues in the next span
+		for ( found = spanEnd - 2 > pos ? spanEnd - 2 : pos; found < spanEnd && found + 2 < end; found++ )
+			if ( GetData( found ) == 0 && GetData( found + 1 ) == 0 && GetData( found + 2 ) == 1 )
+				return found;
+		pos = spanEnd;
+	}
+	return start > end - 2 ? start : end - 2;
+}
+
 int PES::GetLength()
 {
 	return length;
@@ -509,6 +587,8 @@ int PES::GetLength()
 
 void PES::Clear()
 {
+	spans.clear();
+	lastSpan = 0;
 	length = 0;
 	packetDataOffset = -1;
 }
@@ -530,6 +610,14 @@ bool PES::PES_CRC_flag() { return IsHeaderPresent() ? GetBits( 62, 1 ) : 0; }
 bool PES::PES_extension_flag() { return IsHeaderPresent() ? GetBits( 63, 1 ) : 0; }
 unsigned char PES::PES_header_data_length() { return IsHeaderPresent() ? GetBits( 64, 8 ) : 0; }
 
+/// The presentation time stamp in 90 kHz units, -1 if there is none
+long long PES::PTS()
+{
+	if ( !( PTS_DTS_flags() & 0x2 ) )
+		return -1;
+	return ( ( long long ) GetBits( 76, 3 ) << 30 ) | ( GetBits( 80, 15 ) << 15 ) | GetBits( 96, 15 );
+}
+
 bool PES::IsHeaderPresent()
 {
 	// Check the spec for the actual IDs, I'm too lazy to put them here.
@@ -20,6 +20,11 @@
 #ifndef _IEC13818_1_H
 #define _IEC13818_1_H 1
 
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <vector>
+
 #include "error.h"
 
 #define HDV_PACKET_SIZE 188
@@ -42,24 +47,119 @@
 #define BCD(c) ( ((((c) >> 4) & 0x0f) * 10) + ((c) & 0x0f) )
 
 #define TOBYTES( n ) ( ( n + 7 ) / 8 )
-static unsigned char bitmask[8] = { 0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff };
-#define GETBITS( offset, len ) do { \
-	unsigned long value = 0; \
-	while ( len > 0 ) \
-	{ \
-		int bits = 8 - ( offset % 8 ); \
-		unsigned char data = GetData( offset / 8 ) & bitmask[bits-1]; \
-		if ( len > bits ) \
-			value += data << ( len - bits ); \
-		else if ( len < bits ) \
-			value += data >> ( bits - len ); \
-		else \
-			value += data; \
-		offset += bits; \
-		len -= bits; \
-	} \
-	return value; \
-} while (0)
+
+/** Reads big-endian bit fields from a contiguous buffer
+
+    A field is taken from a 64 bit load of the bytes around it, so no
+    field may be longer than 57 bits. Bytes past the end read as 0, as
+    does a field of no bits.
+*/
+
+class BitReader
+{
+public:
+	BitReader( const unsigned char *d, int len ) : data( d ), length( len ) {}
+
+	unsigned long GetBits( int offset, int len ) const
+	{
+		int pos = offset >> 3;
+		uint64_t cache;
+
+		// a shift by 64 bits is undefined
+		if ( len == 0 )
+			return 0;
+
+		if ( pos + 8 <= length )
+		{
+			memcpy( &cache, data + pos, sizeof( cache ) );
+			cache = be64toh( cache );
+		}
+		else
+		{
+			cache = 0;
+			for ( int i = 0; i < 8; i++ )
+				cache = ( cache << 8 ) | ( pos + i < length ? data[ pos + i ] : 0 );
+		}
+		return ( unsigned long ) ( ( cache << ( offset & 7 ) ) >> ( 64 - len ) );
+	}
+
+private:
+	const unsigned char *data;
+	int length;
+};
+
+
+
+/** Finds the next start code prefix 00 00 01 in a contiguous buffer
+
+    Only the 0x01 bytes are looked at, with memchr(), which the C
+    library vectorizes; the two zero bytes before a candidate are then
+    checked. Slice data rarely contains 0x01, so this skips most of it.
+
+    \param data the buffer
+    \param pos the first position to look at
+    \param length the length of the buffer
+    \return the position of the first prefix at or after pos, or else
+    the first position that could not be checked, never before pos
+*/
+
+static inline int FindStartCodePrefix( const unsigned char *data, int pos, int length )
+{
+	const unsigned char *p = data + pos + 2;
+	const unsigned char *end = data + length;
+
+	while ( p < end && ( p = ( const unsigned char* ) memchr( p, 0x01, end - p ) ) )
+	{
+		if ( p[ -1 ] == 0 && p[ -2 ] == 0 )
+			return p - 2 - data;
+		p += 3;
+	}
+	return pos > length - 2 ? pos : length - 2;
+}
+
+
+/** Finds the payload of a TS packet
+
+    \param packet a whole TS packet
+    \param length set to the number of bytes of the payload
+    \return the payload, or NULL if the packet has none
+*/
+
+static inline unsigned char *GetTSPayload( unsigned char *packet, int &length )
+{
+	if ( !( packet[ 3 ] & 0x10 ) )
+		return NULL;
+	if ( !( packet[ 3 ] & 0x20 ) )
+	{
+		length = HDV_PACKET_SIZE - 4;
+		return packet + 4;
+	}
+	if ( packet[ 4 ] >= HDV_PACKET_SIZE - 5 )
+		return NULL;
+	length = HDV_PACKET_SIZE - 5 - packet[ 4 ];
+	return packet + 5 + packet[ 4 ];
+}
+
+
+/** Skips the header of the PES packet a TS payload starts with
+
+    \param payload the payload of a TS packet with payload_unit_start_indicator
+    \param length the bytes of the payload, less those of the header on return
+    \param pts set to the PTS, or -1 if there is none
+    \return the elementary stream data, or NULL if there is no complete header
+*/
+
+static inline unsigned char *SkipPESHeader( unsigned char *payload, int &length, long long &pts )
+{
+	if ( length < 9 || payload[ 0 ] != 0 || payload[ 1 ] != 0 || payload[ 2 ] != 1 || 9 + payload[ 8 ] > length )
+		return NULL;
+	pts = -1;
+	if ( ( payload[ 7 ] & 0x80 ) && payload[ 8 ] >= 5 )
+		pts = ( ( long long ) ( payload[ 9 ] & 0x0e ) << 29 ) | ( payload[ 10 ] << 22 ) |
+		      ( ( payload[ 11 ] & 0xfe ) << 14 ) | ( payload[ 12 ] << 7 ) | ( payload[ 13 ] >> 1 );
+	length -= 9 + payload[ 8 ];
+	return payload + 9 + payload[ 8 ];
+}
 
 
 
@@ -72,7 +172,7 @@ public:
 	void SetData( unsigned char *d, int len );
 	int GetLength();
 	unsigned char GetData( int pos );
-	unsigned long GetBits( int offset, int len ) { GETBITS( offset, len ); }
+	unsigned long GetBits( int offset, int len ) { return BitReader( data, length ).GetBits( offset, len ); }
 	void Dump();
 
 	unsigned char table_id();
@@ -106,7 +206,7 @@ public:
 	void SetData( unsigned char *d, int len );
 	int GetLength();
 	unsigned char GetData( int pos );
-	unsigned long GetBits( int offset, int len ) { GETBITS( offset, len ); }
+	unsigned long GetBits( int offset, int len ) { return BitReader( data, length ).GetBits( offset, len ); }
 	void Dump();
 
 	unsigned char stream_type();
@@ -129,7 +229,7 @@ public:
 	void SetData( unsigned char *d, int len );
 	int GetLength();
 	unsigned char GetData( int pos );
-	unsigned long GetBits( int offset, int len ) { GETBITS( offset, len ); }
+	unsigned long GetBits( int offset, int len ) { return BitReader( data, length ).GetBits( offset, len ); }
 	void Dump();
 
 	unsigned char table_id();
@@ -169,9 +269,9 @@ public:
 
 	void Clear();
 	void AddData( unsigned char *d, int l );
-	unsigned char *GetBuffer();
 	unsigned char GetData( int pos );
-	unsigned long GetBits( int offset, int len ) { GETBITS( offset, len ); }
+	unsigned long GetBits( int offset, int len );
+	int FindStartCode( int pos, int end );
 	int GetLength();
 	void Dump();
 
@@ -191,6 +291,7 @@ public:
 	bool PES_CRC_flag();
 	bool PES_extension_flag();
 	unsigned char PES_header_data_length();
+	long long PTS();
 
 	bool PES_private_data_flag();
 	bool pack_header_field_flag();
@@ -205,10 +306,19 @@ public:
 
 protected:
 	bool IsHeaderPresent();
+	int FindSpan( int pos );
 
 private:
-#define MAX_PES_SIZE 1024*1024
-	unsigned char data[MAX_PES_SIZE];
+	// The PES packet is not copied; these are the payloads of the
+	// transport stream packets that carry it, in the frame being parsed.
+	struct Span
+	{
+		const unsigned char *data;
+		int position;
+		int length;
+	};
+	std::vector<Span> spans;
+	int lastSpan;
 	int length;
 
 	int packetDataOffset;
@@ -225,7 +335,7 @@ public:
 	void SetData( unsigned char *d, int len );
 	int GetLength();
 	unsigned char GetData( int pos );
-	unsigned long GetBits( int offset, int len ) { GETBITS( offset, len ); }
+	unsigned long GetBits( int offset, int len ) { return BitReader( data, length ).GetBits( offset, len ); }
 	void Dump();
 
 	unsigned char year();
@@ -249,26 +359,32 @@ protected:
 
 
 
-class HDVFrame;
 class HDVStreamParams;
 
+/** A TS packet of an HDV stream, as parsed
+
+    There is one for the stream rather than one for each frame: it only
+    points at the packet being parsed, and the tables are parsed in
+    place.
+*/
+
 class HDVPacket
 {
 public:
-	HDVPacket( HDVFrame *f, HDVStreamParams *p );
+	HDVPacket( HDVStreamParams *p );
 	~HDVPacket();
 
 	void SetData( unsigned char *d );
 	int GetLength();
 	unsigned char GetData( int pos );
-	unsigned long GetBits( int offset, int len ) { GETBITS( offset, len ); }
+	unsigned long GetBits( int offset, int len ) { return BitReader( data, HDV_PACKET_SIZE ).GetBits( offset, len ); }
 	void Dump();
 
 	unsigned char sync_byte();
 	bool transport_error_indicator();
 	bool payload_unit_start_indicator();
 	bool transport_priority();
-	unsigned short pid();
+	unsigned short pid() { return packetPID; }
 	unsigned char transport_scrambling_control();
 	unsigned char adaptation_field_control();
 	unsigned char continuity_counter();
@@ -296,8 +412,8 @@ public:
 
 protected:
 	unsigned char *data;
+	unsigned short packetPID;
 
-	HDVFrame *frame;
 	HDVStreamParams *params;
 
 	PAT pat;
@@ -26,54 +26,39 @@ using std::string;
 ///////////////
 // Video Stream
 
-Video::Video()
-{
-	picture = new Picture( this );
-	sequenceHeader = new SequenceHeader( this );
-	sequenceExtension = new SequenceExtension( this );
-	sequenceDisplayExtension = new SequenceDisplayExtension( this );
-	quantMatrixExtension = new QuantMatrixExtension( this );
-	copyrightExtension = new CopyrightExtension( this );
-	sequenceScalableExtension = new SequenceScalableExtension( this );
-	pictureDisplayExtension = new PictureDisplayExtension( this );
-	pictureCodingExtension = new PictureCodingExtension( this );
-	pictureSpatialScalableExtension = new PictureSpatialScalableExtension( this );
-	pictureTemporalScalableExtension = new PictureTemporalScalableExtension( this );
-	userData = new UserData( this );
-	group = new Group( this );
-	slice = new Slice( this );
-
+Video::Video() :
+	picture( this ),
+	sequenceHeader( this ),
+	sequenceExtension( this ),
+	sequenceDisplayExtension( this ),
+	quantMatrixExtension( this ),
+	copyrightExtension( this ),
+	sequenceScalableExtension( this ),
+	pictureDisplayExtension( this ),
+	pictureCodingExtension( this ),
+	pictureSpatialScalableExtension( this ),
+	pictureTemporalScalableExtension( this ),
+	userData( this ),
+	group( this ),
+	slice( this )
+{
 	Clear();
 }
 
 Video::~Video()
 {
-	delete picture;
-	delete sequenceHeader;
-	delete sequenceExtension;
-	delete sequenceDisplayExtension;
-	delete quantMatrixExtension;
-	delete copyrightExtension;
-	delete sequenceScalableExtension;
-	delete pictureDisplayExtension;
-	delete pictureCodingExtension;
-	delete pictureSpatialScalableExtension;
-	delete pictureTemporalScalableExtension;
-	delete userData;
-	delete group;
-	delete slice;
 }
 
 void Video::AddPacket( HDVPacket *packet )
 {
 	if ( offset > 0 && packet->payload_unit_start_indicator() )
 	{
-		if ( lastSection == slice )
+		if ( lastSection == &slice )
 			DEBUG_RAW( d_hdv_video, "*%d", sliceCount );
 		DEBUG_RAW( d_hdv_video, "]" );
 		isComplete = true;
 	}
-	else
+	else if ( pes.GetLength() > 0 || packet->payload_unit_start_indicator() )
 	{
 		pes.AddData( packet->payload(), packet->PayloadLength() );
 		ProcessPacket();
@@ -105,10 +90,13 @@ void Video::Clear()
 	progressive_sequence = -1;
 	scalable_mode = -1;
 
+	picture_coding_type = -1;
+	quantiser_scale_sum = 0;
+	quantiser_scale_count = 0;
+
 	isComplete = false;
 }
 
-unsigned char *Video::GetBuffer() { return &pes.GetBuffer()[pes.GetPacketDataOffset()]; }
 
 unsigned char Video::GetData( int pos )
 {
@@ -123,6 +111,13 @@ int Video::GetLength()
 	return pes.GetPacketDataLength();
 }
 
+int Video::FindStartCode( int pos, int end )
+{
+	int base = pes.GetPacketDataOffset();
+
+	return pes.FindStartCode( base + pos, base + end ) - base;
+}
+
 bool Video::IsComplete()
 {
 	return isComplete;
@@ -147,11 +142,11 @@ void Video::ProcessPacket()
 				{
 				case SEQUENCE_HEADER_CODE_VALUE:
 					dstr = "H";
-					currentSection = sequenceHeader;
+					currentSection = &sequenceHeader;
 					break;
 				case PICTURE_START_CODE_VALUE:
 					dstr = "P";
-					currentSection = picture;
+					currentSection = &picture;
 					break;
 				case EXTENSION_START_CODE_VALUE:
 					extension_code = GetBits( ( offset + 4 ) * 8, 4 );
@@ -159,39 +154,39 @@ void Video::ProcessPacket()
 					{
 					case SEQUENCE_EXTENSION_ID_VALUE:
 						dstr = "SE";
-						currentSection = sequenceExtension;
+						currentSection = &sequenceExtension;
 						break;
 					case SEQUENCE_DISPLAY_EXTENSION_ID_VALUE:
 						dstr = "SDE";
-						currentSection = sequenceDisplayExtension;
+						currentSection = &sequenceDisplayExtension;
 						break;
 					case QUANT_MATRIX_EXTENSION_ID_VALUE:
 						dstr = "QME";
-						currentSection = quantMatrixExtension;
+						currentSection = &quantMatrixExtension;
 						break;
 					case COPYRIGHT_EXTENSION_ID_VALUE:
 						dstr = "CE";
-						currentSection = copyrightExtension;
+						currentSection = &copyrightExtension;
 						break;
 					case SEQUENCE_SCALABLE_EXTENSION_ID_VALUE:
 						dstr = "SSE";
-						currentSection = sequenceScalableExtension;
+						currentSection = &sequenceScalableExtension;
 						break;
 					case PICTURE_DISPLAY_EXTENSION_ID_VALUE:
 						dstr = "PDE";
-						currentSection = pictureDisplayExtension;
+						currentSection = &pictureDisplayExtension;
 						break;
 					case PICTURE_CODING_EXTENSION_ID_VALUE:
 						dstr = "PCE";
-						currentSection = pictureCodingExtension;
+						currentSection = &pictureCodingExtension;
 						break;
 					case PICTURE_SPATIAL_SCALABLE_EXTENSION_ID_VALUE:
 						dstr = "PSSE";
-						currentSection = pictureSpatialScalableExtension;
+						currentSection = &pictureSpatialScalableExtension;
 						break;
 					case PICTURE_TEMPORAL_SCALABLE_EXTENSION_ID_VALUE:
 						dstr = "PTSE";
-						currentSection = pictureTemporalScalableExtension;
+						currentSection = &pictureTemporalScalableExtension;
 						break;
 					default:
 						DEBUG( d_hdv_video, "Unknown Extension %x", extension_code );
@@ -202,11 +197,11 @@ void Video::ProcessPacket()
 					break;
 				case USER_DATA_START_CODE_VALUE:
 					dstr = "U";
-					currentSection = userData;
+					currentSection = &userData;
 					break;
 				case GROUP_START_CODE_VALUE:
 					dstr = "G";
-					currentSection = group;
+					currentSection = &group;
 					break;
 				case SEQUENCE_END_CODE_VALUE:
 					dstr = "END";
@@ -216,7 +211,7 @@ void Video::ProcessPacket()
 				default:
 					if ( SLICE_START_CODE_MIN <= start_code && start_code <= SLICE_START_CODE_MAX )
 					{
-						if ( lastSection == slice )
+						if ( lastSection == &slice )
 						{
 							sliceCount++;
 						}
@@ -225,7 +220,7 @@ void Video::ProcessPacket()
 							dstr = "S";
 							sliceCount = 1;
 						}
-						currentSection = slice;
+						currentSection = &slice;
 					}
 					else
 					{
@@ -238,14 +233,17 @@ void Video::ProcessPacket()
 			}
 			else
 			{
-				DEBUG_RAW( d_hdv_video, "%02x ", GetData(offset) );
-				offset++;
+				int next = FindStartCode( offset + 1, GetLength() );
+				if ( d_hdv_video )
+					for ( int i = offset; i < next; i++ )
+						DEBUG_RAW( d_hdv_video, "%02x ", GetData(i) );
+				offset = next;
 				restart = true;
 			}
 
 			if ( dstr )
 			{
-				if ( lastSection == slice && currentSection != slice )
+				if ( lastSection == &slice && currentSection != &slice )
 					DEBUG_RAW( d_hdv_video, "*%d]", sliceCount );
 
 				DEBUG_RAW( d_hdv_video, "[%s", dstr );
@@ -266,35 +264,42 @@ void Video::ProcessPacket()
 
 		if ( currentSection->IsComplete() )
 		{
-			if ( currentSection != slice )
+			if ( currentSection != &slice )
 				DEBUG_RAW( d_hdv_video, "]" );
 
-			if ( currentSection == sequenceHeader )
+			if ( currentSection == &sequenceHeader )
+			{
+				width = sequenceHeader.horizontal_size_value();
+				height = sequenceHeader.vertical_size_value();
+				frameRate = FRAMERATE_LOOKUP( sequenceHeader.frame_rate_code() );
+			}
+			else if ( currentSection == &picture )
+				picture_coding_type = picture.picture_coding_type();
+			else if ( currentSection == &slice )
 			{
-				width = sequenceHeader->horizontal_size_value();
-				height = sequenceHeader->vertical_size_value();
-				frameRate = FRAMERATE_LOOKUP( sequenceHeader->frame_rate_code() );
+				quantiser_scale_sum += slice.quantiser_scale_code();
+				quantiser_scale_count++;
 			}
-			else if ( currentSection == pictureCodingExtension )
+			else if ( currentSection == &pictureCodingExtension )
 			{
-				repeat_first_field = pictureCodingExtension->repeat_first_field() ? 1 : 0;
-				top_field_first = pictureCodingExtension->top_field_first() ? 1 : 0;
-				picture_structure = pictureCodingExtension->picture_structure();
+				repeat_first_field = pictureCodingExtension.repeat_first_field() ? 1 : 0;
+				top_field_first = pictureCodingExtension.top_field_first() ? 1 : 0;
+				picture_structure = pictureCodingExtension.picture_structure();
 			}
-			else if ( currentSection == group )
+			else if ( currentSection == &group )
 			{
-				timeCode.hour = group->time_code_hours();
-				timeCode.min = group->time_code_minutes();
-				timeCode.sec = group->time_code_seconds();
-				timeCode.frame = group->time_code_pictures();
+				timeCode.hour = group.time_code_hours();
+				timeCode.min = group.time_code_minutes();
+				timeCode.sec = group.time_code_seconds();
+				timeCode.frame = group.time_code_pictures();
 				isTimeCodeSet = true;
 
 				hasGOP = true;
 			}
-			else if ( currentSection == sequenceExtension )
-				progressive_sequence = sequenceExtension->progressive_sequence() ? 1 : 0;
-			else if ( currentSection == sequenceScalableExtension )
-				scalable_mode = sequenceScalableExtension->scalable_mode();
+			else if ( currentSection == &sequenceExtension )
+				progressive_sequence = sequenceExtension.progressive_sequence() ? 1 : 0;
+			else if ( currentSection == &sequenceScalableExtension )
+				scalable_mode = sequenceScalableExtension.scalable_mode();
 
 			currentLen = currentSection->GetCompleteLength() - ( offset - sectionStart );
 			lastSection = currentSection;
@@ -325,11 +330,6 @@ void VideoSection::Clear()
 	length = 0;
 }
 
-void VideoSection::SetOffset( int o ) { offset = o; }
-void VideoSection::AddLength( int l ) { length += l; }
-bool VideoSection::IsComplete() { return GetCompleteLength() > 0; }
-
-unsigned char VideoSection::GetData( int pos ) { return video->GetData( pos + offset ); }
 
 
 
@@ -1128,21 +1128,9 @@ UserData::~UserData()
 
 int UserData::GetCompleteLength()
 {
-	int blen = length * 8;
-	int bits = 32;
+	int pos = video->FindStartCode( offset + 4, offset + length ) - offset;
 
-	if ( blen < bits )
-		return -1;
-
-	while ( !START_CODE_PREFIX( bits / 8 ) )
-	{
-		bits += 8;
-
-		if ( blen < bits )
-			return -1;
-	}
-
-	return TOBYTES( bits );
+	return ( pos + 3 ) < length ? pos : -1;
 }
 
 void UserData::Dump()
@@ -1252,15 +1240,9 @@ int Slice::GetCompleteLength()
 		last_pos = TOBYTES( bits );
 	}
 
-	while ( ( last_pos + 3 ) < length )
-	{
-		if ( START_CODE_PREFIX(last_pos) )
-			return last_pos;
-		else
-			last_pos++;
-	}
+	last_pos = video->FindStartCode( offset + last_pos, offset + length ) - offset;
 
-	return -1;
+	return ( last_pos + 3 ) < length ? last_pos : -1;
 }
 
 //FIXME - remove this when macroblock parsing is added
@@ -96,11 +96,11 @@ public:
 	virtual ~VideoSection();
 
 	virtual void Clear();
-	virtual void SetOffset( int o );
-	virtual void AddLength( int l );
-	virtual bool IsComplete();
-	virtual unsigned char GetData( int pos );
-	virtual unsigned long GetBits( int offset, int len ) { GETBITS( offset, len ); }
+	void SetOffset( int o ) { offset = o; }
+	void AddLength( int l ) { length += l; }
+	bool IsComplete() { return GetCompleteLength() > 0; }
+	unsigned char GetData( int pos );
+	unsigned long GetBits( int o, int l );
 
 	virtual int GetCompleteLength() { return -1; }
 	virtual void Dump() { }
@@ -499,9 +499,10 @@ public:
 	void Clear();
 	void AddPacket( HDVPacket *packet );
 	int GetLength();
-	unsigned char *GetBuffer();
 	unsigned char GetData( int pos );
-	unsigned long GetBits( int o, int l ) { GETBITS( o, l ); }
+	unsigned long GetBits( int o, int l ) { return pes.GetBits( pes.GetPacketDataOffset() * 8 + o, l ); }
+	int FindStartCode( int pos, int end );
+	long long GetPTS() { return pes.PTS(); }
 	bool IsComplete();
 
 	void ProcessPacket();
@@ -520,6 +521,11 @@ public:
 	int progressive_sequence;
 	int scalable_mode;
 
+	// Picture statistics, for scene detection.
+	int picture_coding_type;
+	int quantiser_scale_sum;
+	int quantiser_scale_count;
+
 private:
 	PES pes;
 
@@ -533,22 +539,29 @@ private:
 
 	int sliceCount;
 
-	Picture *picture;
-	SequenceHeader *sequenceHeader;
-	SequenceExtension *sequenceExtension;
-	SequenceDisplayExtension *sequenceDisplayExtension;
-	QuantMatrixExtension *quantMatrixExtension;
-	CopyrightExtension *copyrightExtension;
-	SequenceScalableExtension *sequenceScalableExtension;
-	PictureDisplayExtension *pictureDisplayExtension;
-	PictureCodingExtension *pictureCodingExtension;
-	PictureSpatialScalableExtension *pictureSpatialScalableExtension;
-	PictureTemporalScalableExtension *pictureTemporalScalableExtension;
-	UserData *userData;
-	Group *group;
-	Slice *slice;
+	// The sections are parsed in place; one of each is enough
+	Picture picture;
+	SequenceHeader sequenceHeader;
+	SequenceExtension sequenceExtension;
+	SequenceDisplayExtension sequenceDisplayExtension;
+	QuantMatrixExtension quantMatrixExtension;
+	CopyrightExtension copyrightExtension;
+	SequenceScalableExtension sequenceScalableExtension;
+	PictureDisplayExtension pictureDisplayExtension;
+	PictureCodingExtension pictureCodingExtension;
+	PictureSpatialScalableExtension pictureSpatialScalableExtension;
+	PictureTemporalScalableExtension pictureTemporalScalableExtension;
+	UserData userData;
+	Group group;
+	Slice slice;
 };
 
+inline unsigned char VideoSection::GetData( int pos ) { return video->GetData( pos + offset ); }
+inline unsigned long VideoSection::GetBits( int o, int l )
+{
+	return video->GetBits( offset * 8 + o, l );
+}
+
 
 
 #endif
@@ -73,6 +73,7 @@ using std::endl;
 #include "ieee1394io.h"
 #include "dvframe.h"
 #include "hdvframe.h"
+#include "filehandler.h"
 #include "error.h"
 
 /** Initializes the IEEE1394Reader object.
@@ -116,6 +117,7 @@ IEEE1394Reader::IEEE1394Reader( int c, int bufSize, bool hdv ) :
 	/* Initialise mutex and condition for action triggerring */
 	pthread_mutex_init( &condition_mutex, NULL );
 	pthread_cond_init( &condition, NULL );
+	pthread_cond_init( &frameDone, NULL );
 
 }
 
@@ -133,6 +135,8 @@ IEEE1394Reader::~IEEE1394Reader()
 {
 	Frame * frame;
 
+	Flush();
+
 	for ( int i = inFrames.size(); i > 0; --i )
 	{
 		frame = inFrames[ 0 ];
@@ -152,6 +156,7 @@ IEEE1394Reader::~IEEE1394Reader()
 	}
 	pthread_mutex_destroy( &condition_mutex );
 	pthread_cond_destroy( &condition );
+	pthread_cond_destroy( &frameDone );
 }
 
 
@@ -192,11 +197,27 @@ Frame* IEEE1394Reader::GetFrame()
 void IEEE1394Reader::DoneWithFrame( Frame* frame )
 {
 	pthread_mutex_lock( &mutex );
-	inFrames.push_back( frame );
+	Recycle( frame );
+	pthread_cond_signal( &frameDone );
 	pthread_mutex_unlock( &mutex );
 }
 
 
+/** Put a frame into the inFrames queue once it is no longer in use
+
+    An HDV frame holds on to the frames it has taken packets from, and
+    stays in use itself while the next frame refers to its last packets.
+*/
+
+void IEEE1394Reader::Recycle( Frame* frame )
+{
+	if ( frame->IsHDV() )
+		static_cast< HDVFrame* >( frame )->Release( inFrames );
+	else
+		inFrames.push_back( frame );
+}
+
+
 /** Return the number of dropped frames since last call
 */
 
@@ -226,7 +247,8 @@ int IEEE1394Reader::GetBadFrames( void )
 /** Throw away all currently available frames.
  
     All frames in the outFrames queue are put back to the inFrames
-    queue.  Also the currentFrame is put back too.  */
+    queue.  Also the currentFrame is put back too, as are the HDV
+    packets waiting for the next frame.  */
 
 void IEEE1394Reader::Flush()
 {
@@ -236,13 +258,16 @@ void IEEE1394Reader::Flush()
 	{
 		frame = outFrames[ 0 ];
 		outFrames.pop_front();
-		inFrames.push_back( frame );
+		if ( frame != NULL )
+			Recycle( frame );
 	}
 	if ( currentFrame != NULL )
 	{
-		inFrames.push_back( currentFrame );
+		Recycle( currentFrame );
 		currentFrame = NULL;
 	}
+	hdvStreamParams.ReleaseCarryover( inFrames );
+	hdvStreamParams.video.Clear();
 }
 
 bool IEEE1394Reader::WaitForAction( int seconds )
@@ -563,6 +588,8 @@ int iec61883Reader::Handler( unsigned char *data, int length, int dropped )
 
 	memcpy( &currentFrame->data[currentFrame->GetDataLen()], data, length );
 	currentFrame->AddDataLen( length );
+	if ( currentFrame->IsHDV() )
+		static_cast< HDVFrame* >( currentFrame )->ParseData();
 
 	if ( currentFrame->IsComplete( ) )
 	{
@@ -1073,9 +1100,12 @@ bool pipeReader::Handler()
 	{
 		if ( isHDV )
 		{
-			void *buf = &currentFrame->data[currentFrame->GetDataLen()];
-			if ( ret = ( fread( buf, IEC61883_MPEG2_TSP_SIZE, 1, file ) == 1 ) )
+			unsigned char *buf = &currentFrame->data[currentFrame->GetDataLen()];
+			if ( ret = sync.Read( file, buf ) )
+			{
 				currentFrame->AddDataLen( IEC61883_MPEG2_TSP_SIZE );
+				((HDVFrame*)currentFrame)->ParseData();
+			}
 			else
 				((HDVFrame*)currentFrame)->SetComplete();
 		}
@@ -1148,3 +1178,143 @@ void* pipeReader::Thread()
 	pthread_mutex_unlock( &mutex );
 	return NULL;
 }
+
+
+/** Opens a DV file for remuxing
+ 
+    Selects the file handler from the contents of the file: an AVI
+    file starts with a RIFF header, QuickTime is recognized by
+    libquicktime, anything else is taken to be raw DV.
+ 
+    \return success/failure
+*/
+
+bool fileReader::Open()
+{
+	char magic[ 4 ] = { 0, 0, 0, 0 };
+	FILE *file = fopen( input_file, "rb" );
+
+	if ( file == NULL )
+		return false;
+	// A file too short to have a magic has no frame either
+	if ( fread( magic, sizeof( magic ), 1, file ) != 1 )
+	{
+		fclose( file );
+		return false;
+	}
+	fclose( file );
+
+	if ( memcmp( magic, "RIFF", 4 ) == 0 )
+		handler = new AVIHandler();
+#ifdef HAVE_LIBQUICKTIME
+	else if ( quicktime_check_sig( const_cast< char* >( input_file ) ) )
+		handler = new QtHandler();
+#endif
+	else
+		handler = new RawHandler();
+
+	if ( ! handler->Open( input_file ) )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+
+void fileReader::Close()
+{
+	if ( handler )
+	{
+		delete handler;
+		handler = NULL;
+	}
+}
+
+
+bool fileReader::StartThread()
+{
+	pthread_mutex_lock( &mutex );
+	currentFrame = NULL;
+	isRunning = true;
+	pthread_create( &thread, NULL, ThreadProxy, this );
+	pthread_mutex_unlock( &mutex );
+	return true;
+}
+
+
+void fileReader::StopThread()
+{
+	if ( isRunning )
+	{
+		pthread_mutex_lock( &mutex );
+		isRunning = false;
+		pthread_cond_signal( &frameDone );
+		pthread_mutex_unlock( &mutex );
+		pthread_join( thread, NULL );
+		Flush();
+		TriggerAction( );
+	}
+}
+
+
+void* fileReader::ThreadProxy( void* arg )
+{
+	fileReader* self = static_cast< fileReader* >( arg );
+	return self->Thread();
+}
+
+
+/** The thread reading the frames of the input file
+ 
+    Reads ahead as far as there are free frames, so that several
+    frames are in flight between reading and writing.
+*/
+
+void* fileReader::Thread()
+{
+	int total = 0;
+
+	if ( Open() )
+		total = handler->GetTotalFrames();
+	else
+		sendEvent( "Unable to open %s", input_file );
+
+	for ( int i = 0; i < total; )
+	{
+		Frame *frame = NULL;
+
+		// wait for the writer to return a frame
+		pthread_mutex_lock( &mutex );
+		while ( isRunning && inFrames.empty() )
+			pthread_cond_wait( &frameDone, &mutex );
+		if ( isRunning )
+		{
+			frame = inFrames.front();
+			inFrames.pop_front();
+		}
+		pthread_mutex_unlock( &mutex );
+
+		if ( frame == NULL )
+			break;
+
+		frame->Clear();
+		if ( handler->GetFrame( frame, i++ ) < 0 || frame->GetDataLen() == 0 )
+		{
+			DoneWithFrame( frame );
+			break;
+		}
+
+		pthread_mutex_lock( &mutex );
+		outFrames.push_back( frame );
+		TriggerAction( );
+		pthread_mutex_unlock( &mutex );
+	}
+
+	sendEvent( "End of file" );
+	pthread_mutex_lock( &mutex );
+	outFrames.push_back( NULL );
+	TriggerAction( );
+	pthread_mutex_unlock( &mutex );
+	return NULL;
+}
@@ -32,8 +32,10 @@ using std::string;
 using std::deque;
 
 #include "hdvframe.h"
+#include "tssync.h"
 
 class Frame;
+class FileHandler;
 
 class IEEE1394Reader
 {
@@ -99,6 +101,9 @@ protected:
 	pthread_mutex_t condition_mutex;
 	pthread_cond_t condition;
 
+	/// signalled with mutex held when DoneWithFrame() gives back a frame
+	pthread_cond_t frameDone;
+
 	/// A state variable for starting and stopping thread
 	bool isRunning;
 
@@ -107,6 +112,7 @@ protected:
 	HDVStreamParams hdvStreamParams;
 
 	void Flush( void );
+	void Recycle( Frame* );
 };
 
 
@@ -254,6 +260,39 @@ private:
 
 	FILE *file;
 	const char *input_file;
+	TSSync sync;
+};
+
+
+class fileReader: public IEEE1394Reader
+{
+public:
+
+	fileReader( const char *filename, int frames = 50 ) :
+		IEEE1394Reader( 0, frames, false ), input_file( filename ), handler( NULL )
+	{};
+	~fileReader()
+	{
+		Close();
+	};
+
+	bool Open( void );
+	void Close( void );
+	bool StartReceive( void )
+	{
+		return true;
+	};
+	void StopReceive( void )
+	{};
+	bool StartThread( void );
+	void StopThread( void );
+	void* Thread( );
+
+private:
+	static void* ThreadProxy( void *arg );
+
+	const char *input_file;
+	FileHandler *handler;
 };
 
 
@@ -0,0 +1,679 @@
+/*
+* mp4.cc -- Fragmented MP4 file writer
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "mp4.h"
+
+#define MP4_VIDEO_TRACK 1
+#define MP4_AUDIO_TRACK 2
+
+/// trun flags
+#define MP4_TRUN_DATA_OFFSET 0x000001
+#define MP4_TRUN_DURATION 0x000100
+#define MP4_TRUN_SIZE 0x000200
+#define MP4_TRUN_FLAGS 0x000400
+#define MP4_TRUN_COMPOSITION_OFFSET 0x000800
+
+/// tfhd flag: data offsets count from the start of the moof box
+#define MP4_TFHD_DEFAULT_BASE_IS_MOOF 0x020000
+
+/// sample flags of an I picture and of any other picture
+#define MP4_SAMPLE_SYNC 0x02000000
+#define MP4_SAMPLE_NON_SYNC 0x01010000
+
+typedef std::vector< unsigned char > Buffer;
+
+
+static void Put8( Buffer &b, uint32_t v )
+{
+	b.push_back( v );
+}
+
+static void Put16( Buffer &b, uint32_t v )
+{
+	b.push_back( v >> 8 );
+	b.push_back( v );
+}
+
+static void Put24( Buffer &b, uint32_t v )
+{
+	b.push_back( v >> 16 );
+	Put16( b, v );
+}
+
+static void Put32( Buffer &b, uint32_t v )
+{
+	Put16( b, v >> 16 );
+	Put16( b, v );
+}
+
+static void Put64( Buffer &b, uint64_t v )
+{
+	Put32( b, v >> 32 );
+	Put32( b, v );
+}
+
+static void PutData( Buffer &b, const void *data, size_t length )
+{
+	b.insert( b.end(), ( const unsigned char* ) data, ( const unsigned char* ) data + length );
+}
+
+static void PutZeros( Buffer &b, size_t length )
+{
+	b.insert( b.end(), length, 0 );
+}
+
+static void Patch32( Buffer &b, size_t position, uint32_t v )
+{
+	b[ position ] = v >> 24;
+	b[ position + 1 ] = v >> 16;
+	b[ position + 2 ] = v >> 8;
+	b[ position + 3 ] = v;
+}
+
+/** Starts a box, whose size is filled in by EndBox
+
+    \return the position of the box
+*/
+
+static size_t BeginBox( Buffer &b, const char *type )
+{
+	size_t position = b.size();
+	Put32( b, 0 );
+	PutData( b, type, 4 );
+	return position;
+}
+
+static size_t BeginFullBox( Buffer &b, const char *type, int version, uint32_t flags )
+{
+	size_t position = BeginBox( b, type );
+	Put8( b, version );
+	Put24( b, flags );
+	return position;
+}
+
+static void EndBox( Buffer &b, size_t position )
+{
+	Patch32( b, position, b.size() - position );
+}
+
+/** Starts an MPEG-4 systems descriptor
+
+    The size is always written in four bytes, so it can be filled in by
+    EndDescriptor without moving the contents.
+*/
+
+static size_t BeginDescriptor( Buffer &b, int tag )
+{
+	size_t position = b.size();
+	Put8( b, tag );
+	Put32( b, 0x80808000 );
+	return position;
+}
+
+static void EndDescriptor( Buffer &b, size_t position )
+{
+	size_t length = b.size() - position - 5;
+	b[ position + 1 ] = 0x80 | ( ( length >> 21 ) & 0x7f );
+	b[ position + 2 ] = 0x80 | ( ( length >> 14 ) & 0x7f );
+	b[ position + 3 ] = 0x80 | ( ( length >> 7 ) & 0x7f );
+	b[ position + 4 ] = length & 0x7f;
+}
+
+static void PutMatrix( Buffer &b )
+{
+	static const uint32_t unity[ 9 ] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+
+	for ( int i = 0; i < 9; i++ )
+		Put32( b, unity[ i ] );
+}
+
+
+MP4Track::MP4Track() :
+		id( 0 ), timescale( 0 ), objectType( 0 ), width( 0 ), height( 0 ), hSpacing( 1 ), vSpacing( 1 ),
+		channels( 0 ), decodeTime( 0 )
+{}
+
+
+bool MP4Track::IsSet()
+{
+	return objectType != 0;
+}
+
+
+MP4File::MP4File() : fd( -1 ), ownsFile( false ), fileSize( 0 ), isMovieWritten( false ), sequenceNumber( 0 )
+{}
+
+
+MP4File::~MP4File()
+{
+	Close();
+}
+
+
+bool MP4File::Create( const std::string &filename )
+{
+	Close();
+	fd = open( filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644 );
+	ownsFile = true;
+	return fd != -1;
+}
+
+
+/** Writes to a file that is already open, such as stdout
+
+    \param fd the file, which is not closed by Close
+*/
+
+void MP4File::Attach( int fd )
+{
+	Close();
+	this->fd = fd;
+	ownsFile = false;
+}
+
+
+bool MP4File::IsOpen()
+{
+	return fd != -1;
+}
+
+
+/** Writes the samples collected so far and closes the file
+
+    \return false if the last fragment could not be written
+*/
+
+bool MP4File::Close()
+{
+	bool result = true;
+
+	if ( fd == -1 )
+		return true;
+	if ( HasSamples() )
+		result = WriteFragment();
+	if ( ownsFile )
+		close( fd );
+	fd = -1;
+	fileSize = 0;
+	isMovieWritten = false;
+	sequenceNumber = 0;
+	video = MP4Track();
+	audio = MP4Track();
+	return result;
+}
+
+
+/// the bytes written and still to write
+off_t MP4File::GetFileSize()
+{
+	return fileSize + video.data.size() + audio.data.size();
+}
+
+
+/** Sets the format of the video track
+
+    \param width coded width
+    \param height coded height
+    \param hSpacing relative width of a pixel
+    \param vSpacing relative height of a pixel
+    \param config the sequence header and its extensions
+    \param length the bytes of config
+*/
+
+void MP4File::SetVideoFormat( int width, int height, int hSpacing, int vSpacing, const unsigned char *config, int length )
+{
+	if ( isMovieWritten )
+		return;
+	video.id = MP4_VIDEO_TRACK;
+	video.timescale = 90000;
+	video.objectType = MP4_OTI_MPEG2_MAIN_VIDEO;
+	video.width = width;
+	video.height = height;
+	video.hSpacing = hSpacing;
+	video.vSpacing = vSpacing;
+	video.config.assign( config, config + length );
+}
+
+
+void MP4File::SetAudioFormat( int objectType, int sampleRate, int channels )
+{
+	if ( isMovieWritten )
+		return;
+	audio.id = MP4_AUDIO_TRACK;
+	audio.timescale = sampleRate;
+	audio.objectType = objectType;
+	audio.channels = channels;
+}
+
+
+bool MP4File::IsVideoFormatSet()
+{
+	return video.IsSet();
+}
+
+
+bool MP4File::IsAudioFormatSet()
+{
+	return audio.IsSet();
+}
+
+
+/** Sets where the first audio sample is on the time line
+
+    \param time in units of the sample rate
+*/
+
+void MP4File::SetAudioDecodeTime( uint64_t time )
+{
+	audio.decodeTime = time;
+}
+
+
+/** Adds a picture to the fragment
+
+    \param duration in 90 kHz units
+    \param compositionOffset the display time less the decode time, in 90 kHz units
+    \param isSync whether the picture is an I picture
+*/
+
+void MP4File::AddVideoSample( const unsigned char *data, int length, int duration, int compositionOffset, bool isSync )
+{
+	MP4Sample sample = { ( uint32_t ) length, ( uint32_t ) duration,
+	                     ( uint32_t ) ( isSync ? MP4_SAMPLE_SYNC : MP4_SAMPLE_NON_SYNC ), compositionOffset };
+
+	if ( !video.IsSet() )
+		return;
+	video.samples.push_back( sample );
+	PutData( video.data, data, length );
+}
+
+
+/** Adds an audio frame to the fragment
+
+    \param duration in units of the sample rate
+*/
+
+void MP4File::AddAudioSample( const unsigned char *data, int length, int duration )
+{
+	MP4Sample sample = { ( uint32_t ) length, ( uint32_t ) duration, 0, 0 };
+
+	if ( !audio.IsSet() )
+		return;
+	audio.samples.push_back( sample );
+	PutData( audio.data, data, length );
+}
+
+
+bool MP4File::HasSamples()
+{
+	return !video.samples.empty() || !audio.samples.empty();
+}
+
+
+/** Writes the samples collected so far as a movie fragment
+
+    The file header and the movie box go before the first fragment.
+
+    \return false if the file could not be written
+*/
+
+bool MP4File::WriteFragment()
+{
+	if ( fd == -1 || !video.IsSet() )
+		return false;
+
+	header.clear();
+	dataOffsets.clear();
+	if ( !isMovieWritten )
+		WriteMovie( header );
+
+	size_t moof = BeginBox( header, "moof" );
+	size_t box = BeginFullBox( header, "mfhd", 0, 0 );
+	Put32( header, ++sequenceNumber );
+	EndBox( header, box );
+	size_t dataOffset = 0;
+	WriteTrackFragment( header, video, dataOffset );
+	WriteTrackFragment( header, audio, dataOffset );
+	EndBox( header, moof );
+
+	size_t moofSize = header.size() - moof;
+	for ( unsigned int i = 0; i < dataOffsets.size(); i++ )
+	{
+		size_t p = dataOffsets[ i ];
+		uint32_t offset = ( header[ p ] << 24 ) | ( header[ p + 1 ] << 16 ) | ( header[ p + 2 ] << 8 ) | header[ p + 3 ];
+		Patch32( header, p, moofSize + 8 + offset );
+	}
+	Put32( header, 8 + video.data.size() + audio.data.size() );
+	PutData( header, "mdat", 4 );
+
+	struct iovec spans[ 3 ];
+	int count = 0;
+	spans[ count ].iov_base = &header[ 0 ];
+	spans[ count++ ].iov_len = header.size();
+	if ( !video.data.empty() )
+	{
+		spans[ count ].iov_base = &video.data[ 0 ];
+		spans[ count++ ].iov_len = video.data.size();
+	}
+	if ( !audio.data.empty() )
+	{
+		spans[ count ].iov_base = &audio.data[ 0 ];
+		spans[ count++ ].iov_len = audio.data.size();
+	}
+	if ( !WriteAll( spans, count ) )
+		return false;
+
+	fileSize += header.size() + video.data.size() + audio.data.size();
+	video.data.clear();
+	video.samples.clear();
+	audio.data.clear();
+	audio.samples.clear();
+	return true;
+}
+
+
+/** Writes the ftyp and moov boxes */
+
+void MP4File::WriteMovie( Buffer &b )
+{
+	size_t box = BeginBox( b, "ftyp" );
+	PutData( b, "mp42", 4 );
+	Put32( b, 0 );
+	PutData( b, "mp42isomiso6", 12 );
+	EndBox( b, box );
+
+	size_t moov = BeginBox( b, "moov" );
+	box = BeginFullBox( b, "mvhd", 0, 0 );
+	Put32( b, 0 );	// creation time
+	Put32( b, 0 );	// modification time
+	Put32( b, 1000 );	// timescale
+	Put32( b, 0 );	// duration: the sum of the fragments
+	Put32( b, 0x00010000 );	// rate
+	Put16( b, 0x0100 );	// volume
+	PutZeros( b, 10 );
+	PutMatrix( b );
+	PutZeros( b, 24 );
+	Put32( b, MP4_AUDIO_TRACK + 1 );	// next track ID
+	EndBox( b, box );
+
+	WriteTrack( b, video );
+	if ( audio.IsSet() )
+		WriteTrack( b, audio );
+
+	size_t mvex = BeginBox( b, "mvex" );
+	for ( int i = 0; i < 2; i++ )
+	{
+		MP4Track &track = i ? audio : video;
+		if ( !track.IsSet() )
+			continue;
+		box = BeginFullBox( b, "trex", 0, 0 );
+		Put32( b, track.id );
+		Put32( b, 1 );	// sample description index
+		Put32( b, 0 );	// default duration
+		Put32( b, 0 );	// default size
+		Put32( b, 0 );	// default flags
+		EndBox( b, box );
+	}
+	EndBox( b, mvex );
+	EndBox( b, moov );
+	isMovieWritten = true;
+}
+
+
+/** Writes the trak box of a track, whose sample tables are empty */
+
+void MP4File::WriteTrack( Buffer &b, MP4Track &track )
+{
+	bool isVideo = &track == &video;
+
+	size_t trak = BeginBox( b, "trak" );
+	size_t box = BeginFullBox( b, "tkhd", 0, 3 );	// enabled, in movie
+	Put32( b, 0 );	// creation time
+	Put32( b, 0 );	// modification time
+	Put32( b, track.id );
+	Put32( b, 0 );
+	Put32( b, 0 );	// duration
+	PutZeros( b, 8 );
+	Put16( b, 0 );	// layer
+	Put16( b, 0 );	// alternate group
+	Put16( b, isVideo ? 0 : 0x0100 );	// volume
+	Put16( b, 0 );
+	PutMatrix( b );
+	Put32( b, isVideo ? ( track.width * track.hSpacing / track.vSpacing ) << 16 : 0 );
+	Put32( b, isVideo ? track.height << 16 : 0 );
+	EndBox( b, box );
+
+	size_t mdia = BeginBox( b, "mdia" );
+	box = BeginFullBox( b, "mdhd", 0, 0 );
+	Put32( b, 0 );	// creation time
+	Put32( b, 0 );	// modification time
+	Put32( b, track.timescale );
+	Put32( b, 0 );	// duration
+	Put16( b, 0x55c4 );	// language "und"
+	Put16( b, 0 );
+	EndBox( b, box );
+
+	box = BeginFullBox( b, "hdlr", 0, 0 );
+	Put32( b, 0 );
+	PutData( b, isVideo ? "vide" : "soun", 4 );
+	PutZeros( b, 12 );
+	const char *name = isVideo ? "VideoHandler" : "SoundHandler";
+	PutData( b, name, strlen( name ) + 1 );
+	EndBox( b, box );
+
+	size_t minf = BeginBox( b, "minf" );
+	if ( isVideo )
+	{
+		box = BeginFullBox( b, "vmhd", 0, 1 );
+		PutZeros( b, 8 );	// graphics mode, opcolor
+	}
+	else
+	{
+		box = BeginFullBox( b, "smhd", 0, 0 );
+		PutZeros( b, 4 );	// balance
+	}
+	EndBox( b, box );
+
+	size_t dinf = BeginBox( b, "dinf" );
+	size_t dref = BeginFullBox( b, "dref", 0, 0 );
+	Put32( b, 1 );
+	box = BeginFullBox( b, "url ", 0, 1 );	// the data is in this file
+	EndBox( b, box );
+	EndBox( b, dref );
+	EndBox( b, dinf );
+
+	size_t stbl = BeginBox( b, "stbl" );
+	box = BeginFullBox( b, "stsd", 0, 0 );
+	Put32( b, 1 );
+	WriteSampleEntry( b, track );
+	EndBox( b, box );
+	const char *tables[] = { "stts", "stsc", "stco" };
+	for ( int i = 0; i < 3; i++ )
+	{
+		box = BeginFullBox( b, tables[ i ], 0, 0 );
+		Put32( b, 0 );
+		EndBox( b, box );
+	}
+	box = BeginFullBox( b, "stsz", 0, 0 );
+	Put32( b, 0 );	// sample size
+	Put32( b, 0 );	// sample count
+	EndBox( b, box );
+	EndBox( b, stbl );
+
+	EndBox( b, minf );
+	EndBox( b, mdia );
+	EndBox( b, trak );
+}
+
+
+/** Writes the mp4v or mp4a sample entry of a track with its esds box */
+
+void MP4File::WriteSampleEntry( Buffer &b, MP4Track &track )
+{
+	bool isVideo = &track == &video;
+	size_t entry = BeginBox( b, isVideo ? "mp4v" : "mp4a" );
+
+	PutZeros( b, 6 );
+	Put16( b, 1 );	// data reference index
+	if ( isVideo )
+	{
+		PutZeros( b, 16 );
+		Put16( b, track.width );
+		Put16( b, track.height );
+		Put32( b, 0x00480000 );	// 72 dpi
+		Put32( b, 0x00480000 );
+		Put32( b, 0 );
+		Put16( b, 1 );	// frame count
+		PutZeros( b, 32 );	// compressor name
+		Put16( b, 0x0018 );	// depth
+		Put16( b, 0xffff );
+	}
+	else
+	{
+		PutZeros( b, 8 );
+		Put16( b, track.channels );
+		Put16( b, 16 );	// sample size
+		Put32( b, 0 );
+		Put32( b, track.timescale << 16 );
+	}
+
+	size_t esds = BeginFullBox( b, "esds", 0, 0 );
+	size_t es = BeginDescriptor( b, 0x03 );
+	Put16( b, track.id );
+	Put8( b, 0 );
+	size_t decoderConfig = BeginDescriptor( b, 0x04 );
+	Put8( b, track.objectType );
+	Put8( b, ( isVideo ? 0x04 : 0x05 ) << 2 | 1 );	// stream type
+	Put24( b, 0 );	// buffer size
+	Put32( b, 0 );	// maximum bit rate
+	Put32( b, 0 );	// average bit rate
+	if ( !track.config.empty() )
+	{
+		size_t info = BeginDescriptor( b, 0x05 );
+		PutData( b, &track.config[ 0 ], track.config.size() );
+		EndDescriptor( b, info );
+	}
+	EndDescriptor( b, decoderConfig );
+	size_t sl = BeginDescriptor( b, 0x06 );
+	Put8( b, 0x02 );	// predefined for MP4 files
+	EndDescriptor( b, sl );
+	EndDescriptor( b, es );
+	EndBox( b, esds );
+
+	if ( isVideo && track.hSpacing != track.vSpacing )
+	{
+		size_t pasp = BeginBox( b, "pasp" );
+		Put32( b, track.hSpacing );
+		Put32( b, track.vSpacing );
+		EndBox( b, pasp );
+	}
+	EndBox( b, entry );
+}
+
+
+/** Writes the traf box of a track
+
+    \param dataOffset the position of the samples of the track within
+    the mdat box, advanced past them
+*/
+
+void MP4File::WriteTrackFragment( Buffer &b, MP4Track &track, size_t &dataOffset )
+{
+	bool isVideo = &track == &video;
+	uint32_t flags = MP4_TRUN_DATA_OFFSET | MP4_TRUN_DURATION | MP4_TRUN_SIZE;
+
+	if ( track.samples.empty() )
+		return;
+	if ( isVideo )
+		flags |= MP4_TRUN_FLAGS | MP4_TRUN_COMPOSITION_OFFSET;
+
+	size_t traf = BeginBox( b, "traf" );
+	size_t box = BeginFullBox( b, "tfhd", 0, MP4_TFHD_DEFAULT_BASE_IS_MOOF );
+	Put32( b, track.id );
+	EndBox( b, box );
+
+	box = BeginFullBox( b, "tfdt", 1, 0 );
+	Put64( b, track.decodeTime );
+	EndBox( b, box );
+
+	// version 1 for negative composition offsets
+	box = BeginFullBox( b, "trun", 1, flags );
+	Put32( b, track.samples.size() );
+	dataOffsets.push_back( b.size() );
+	Put32( b, dataOffset );
+	for ( unsigned int i = 0; i < track.samples.size(); i++ )
+	{
+		MP4Sample &sample = track.samples[ i ];
+		Put32( b, sample.duration );
+		Put32( b, sample.size );
+		if ( isVideo )
+		{
+			Put32( b, sample.flags );
+			Put32( b, sample.compositionOffset );
+		}
+		track.decodeTime += sample.duration;
+	}
+	EndBox( b, box );
+	EndBox( b, traf );
+
+	dataOffset += track.data.size();
+}
+
+
+/** Writes the spans in order, retrying partial writes
+
+    \return false on an error
+*/
+
+bool MP4File::WriteAll( struct iovec *spans, int count )
+{
+	while ( count > 0 )
+	{
+		ssize_t written = writev( fd, spans, count < IOV_MAX ? count : IOV_MAX );
+		if ( written <= 0 )
+		{
+			if ( errno == EINTR || errno == EAGAIN )
+				continue;
+			return false;
+		}
+		while ( count > 0 && ( size_t ) written >= spans->iov_len )
+		{
+			written -= spans->iov_len;
+			spans++;
+			count--;
+		}
+		if ( count > 0 )
+		{
+			spans->iov_base = ( unsigned char* ) spans->iov_base + written;
+			spans->iov_len -= written;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,126 @@
+/*
+* mp4.h -- Fragmented MP4 file writer
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DVGRAB_MP4_H
+#define DVGRAB_MP4_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/// MPEG-4 systems object type indications
+#define MP4_OTI_MPEG2_MAIN_VIDEO 0x61
+#define MP4_OTI_MPEG2_AUDIO 0x69
+#define MP4_OTI_MPEG1_AUDIO 0x6B
+
+/** A sample of a track in the fragment being collected */
+
+struct MP4Sample
+{
+	uint32_t size;
+	uint32_t duration;
+	uint32_t flags;
+	int32_t compositionOffset;
+};
+
+/** A track of an MP4 file */
+
+struct MP4Track
+{
+	uint32_t id;
+	uint32_t timescale;
+	int objectType;
+	std::vector< unsigned char > config;
+
+	// video
+	int width;
+	int height;
+	int hSpacing;
+	int vSpacing;
+
+	// audio
+	int channels;
+
+	/// the decode time of the first sample of the next fragment
+	uint64_t decodeTime;
+	std::vector< MP4Sample > samples;
+	std::vector< unsigned char > data;
+
+	MP4Track();
+	bool IsSet();
+};
+
+/** Writes a fragmented MP4 file with an MPEG-2 video and an MPEG audio track
+
+    The movie box lists the tracks but no samples. The samples follow in
+    movie fragments, each a moof box with the sample tables and an mdat
+    box with the samples of both tracks. A fragment is only written once
+    it is complete and nothing is written twice, so the file is never
+    sought in, can be a pipe, and is playable up to its last fragment if
+    the capture is interrupted.
+
+    The formats of the tracks must be set before the first fragment is
+    written. A track whose format is not set by then is left out.
+*/
+
+class MP4File
+{
+public:
+	MP4File();
+	~MP4File();
+
+	bool Create( const std::string &filename );
+	void Attach( int fd );
+	bool IsOpen();
+	bool Close();
+	off_t GetFileSize();
+
+	void SetVideoFormat( int width, int height, int hSpacing, int vSpacing, const unsigned char *config, int length );
+	void SetAudioFormat( int objectType, int sampleRate, int channels );
+	bool IsVideoFormatSet();
+	bool IsAudioFormatSet();
+	void SetAudioDecodeTime( uint64_t time );
+
+	void AddVideoSample( const unsigned char *data, int length, int duration, int compositionOffset, bool isSync );
+	void AddAudioSample( const unsigned char *data, int length, int duration );
+	bool HasSamples();
+	bool WriteFragment();
+
+private:
+	void WriteMovie( std::vector< unsigned char > &b );
+	void WriteTrack( std::vector< unsigned char > &b, MP4Track &track );
+	void WriteSampleEntry( std::vector< unsigned char > &b, MP4Track &track );
+	void WriteTrackFragment( std::vector< unsigned char > &b, MP4Track &track, size_t &dataOffset );
+	bool WriteAll( struct iovec *spans, int count );
+
+	int fd;
+	bool ownsFile;
+	off_t fileSize;
+	bool isMovieWritten;
+	uint32_t sequenceNumber;
+	MP4Track video;
+	MP4Track audio;
+	std::vector< unsigned char > header;
+	// the positions of the trun data offsets in header
+	std::vector< size_t > dataOffsets;
+};
+
+#endif
@@ -0,0 +1,264 @@
+/*
+* pidfilter.cc -- Selects the packets of an MPEG-2 transport stream to keep
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "pidfilter.h"
+#include "iec13818-1.h"
+
+
+/** Computes the CRC of a PSI section, MSB first with polynomial 0x04c11db7 */
+
+static uint32_t SectionCRC( const unsigned char *data, int length )
+{
+	uint32_t crc = 0xffffffff;
+
+	for ( int i = 0; i < length; i++ )
+	{
+		crc ^= data[ i ] << 24;
+		for ( int bit = 0; bit < 8; bit++ )
+			crc = ( crc & 0x80000000 ) ? ( crc << 1 ) ^ 0x04c11db7 : crc << 1;
+	}
+	return crc;
+}
+
+
+PIDFilter::PIDFilter() :
+		keepVideo( false ), keepAudio( false ), dropNull( false ),
+		videoPID( 0 ), audioPID( 0 ), pmtPID( 0 ), pcrPID( 0 )
+{
+	Update();
+}
+
+
+/// Keeps the packets of a PID, which drops those of all PIDs not kept
+void PIDFilter::Keep( int pid )
+{
+	pids.push_back( pid & 0x1fff );
+	Update();
+}
+
+
+/// Keeps the video of the program, whatever its PID
+void PIDFilter::KeepVideo()
+{
+	keepVideo = true;
+	Update();
+}
+
+
+/// Keeps the audio of the program, whatever its PID
+void PIDFilter::KeepAudio()
+{
+	keepAudio = true;
+	Update();
+}
+
+
+void PIDFilter::SetDropNull( bool drop )
+{
+	dropNull = drop;
+	Update();
+}
+
+
+bool PIDFilter::IsEnabled()
+{
+	return dropNull || keepVideo || keepAudio || !pids.empty();
+}
+
+
+/** Sets the PIDs of the video and audio of the program
+
+    \param video the video PID, 0 if not known yet
+    \param audio the audio PID, 0 if not known yet
+*/
+
+void PIDFilter::SetStreamPIDs( int video, int audio )
+{
+	if ( video != videoPID || audio != audioPID )
+	{
+		videoPID = video;
+		audioPID = audio;
+		Update();
+	}
+}
+
+
+/** Builds the table of what to do with each PID */
+
+void PIDFilter::Update()
+{
+	bool isSelecting = keepVideo || keepAudio || !pids.empty();
+
+	memset( actions, isSelecting ? DROP : KEEP, sizeof( actions ) );
+	for ( unsigned int i = 0; i < pids.size(); i++ )
+		actions[ pids[ i ] ] = KEEP;
+	if ( keepVideo && videoPID )
+		actions[ videoPID ] = KEEP;
+	if ( keepAudio && audioPID )
+		actions[ audioPID ] = KEEP;
+	if ( pcrPID )
+		actions[ pcrPID ] = KEEP;
+	if ( dropNull )
+		actions[ PID_NULL_PACKET ] = DROP;
+	if ( pmtPID )
+		actions[ pmtPID ] = isSelecting ? PMT : KEEP;
+	actions[ 0 ] = PAT;
+}
+
+
+/** Appends the spans of the packets to keep
+
+    A PMT is rewritten in place.
+
+    \param data whole TS packets
+    \param length the bytes of data
+    \param spans gets the runs of packets to keep
+*/
+
+void PIDFilter::Filter( unsigned char *data, int length, std::vector< struct iovec > &spans )
+{
+	unsigned char *run = NULL;
+	int i;
+
+	for ( i = 0; i + HDV_PACKET_SIZE <= length; i += HDV_PACKET_SIZE )
+	{
+		unsigned char *packet = data + i;
+		int action = actions[ ( ( packet[ 1 ] & 0x1f ) << 8 ) | packet[ 2 ] ];
+
+		if ( action == PAT && packet[ 0 ] == HDV_PACKET_MARKER )
+			ProcessPAT( packet );
+		else if ( action == PMT && packet[ 0 ] == HDV_PACKET_MARKER )
+			ProcessPMT( packet );
+
+		if ( action == DROP && run )
+		{
+			struct iovec span = { run, ( size_t ) ( packet - run ) };
+			spans.push_back( span );
+			run = NULL;
+		}
+		else if ( action != DROP && run == NULL )
+		{
+			run = packet;
+		}
+	}
+	if ( run )
+	{
+		struct iovec span = { run, ( size_t ) ( data + i - run ) };
+		spans.push_back( span );
+	}
+}
+
+
+/** Finds the PMT PID of the program in the PAT */
+
+void PIDFilter::ProcessPAT( unsigned char *packet )
+{
+	unsigned char *payload;
+	int length;
+
+	if ( !( packet[ 1 ] & 0x40 ) || !( payload = GetTSPayload( packet, length ) ) )
+		return;
+	if ( length < 1 + payload[ 0 ] + 8 )
+		return;
+
+	unsigned char *section = payload + 1 + payload[ 0 ];
+	int end = 3 + ( ( ( section[ 1 ] & 0x0f ) << 8 ) | section[ 2 ] ) - 4;
+	if ( section[ 0 ] != 0x00 || section + end > payload + length )
+		return;
+
+	for ( int i = 8; i + 4 <= end; i += 4 )
+	{
+		int program = ( section[ i ] << 8 ) | section[ i + 1 ];
+		int pid = ( ( section[ i + 2 ] & 0x1f ) << 8 ) | section[ i + 3 ];
+		if ( program != 0 && pid != pmtPID )
+		{
+			pmtPID = pid;
+			Update();
+			break;
+		}
+	}
+}
+
+
+/** Keeps the PCR PID and rewrites the PMT without the streams dropped
+
+    Only a PMT in a single packet, as in HDV, is rewritten.
+*/
+
+void PIDFilter::ProcessPMT( unsigned char *packet )
+{
+	unsigned char *payload;
+	int length;
+
+	if ( !( packet[ 1 ] & 0x40 ) || !( payload = GetTSPayload( packet, length ) ) )
+		return;
+	if ( length < 1 + payload[ 0 ] + 12 )
+		return;
+
+	unsigned char *section = payload + 1 + payload[ 0 ];
+	int sectionLength = ( ( section[ 1 ] & 0x0f ) << 8 ) | section[ 2 ];
+	if ( section[ 0 ] != 0x02 || section + 3 + sectionLength > payload + length )
+		return;
+
+	int pcr = ( ( section[ 8 ] & 0x1f ) << 8 ) | section[ 9 ];
+	if ( pcr != pcrPID && pcr != PID_NULL_PACKET )
+	{
+		pcrPID = pcr;
+		Update();
+	}
+
+	int end = 3 + sectionLength - 4;
+	int out = 12 + ( ( ( section[ 10 ] & 0x0f ) << 8 ) | section[ 11 ] );
+	int i;
+	for ( i = out; i + 5 <= end; i += 5 + ( ( ( section[ i + 3 ] & 0x0f ) << 8 ) | section[ i + 4 ] ) );
+	if ( i != end )
+		return;
+
+	for ( i = out; i < end; )
+	{
+		int pid = ( ( section[ i + 1 ] & 0x1f ) << 8 ) | section[ i + 2 ];
+		int size = 5 + ( ( ( section[ i + 3 ] & 0x0f ) << 8 ) | section[ i + 4 ] );
+		if ( actions[ pid ] != DROP )
+		{
+			memmove( section + out, section + i, size );
+			out += size;
+		}
+		i += size;
+	}
+	if ( out == end )
+		return;
+
+	sectionLength = out + 4 - 3;
+	section[ 1 ] = ( section[ 1 ] & 0xf0 ) | ( sectionLength >> 8 );
+	section[ 2 ] = sectionLength;
+	uint32_t crc = SectionCRC( section, out );
+	section[ out ] = crc >> 24;
+	section[ out + 1 ] = crc >> 16;
+	section[ out + 2 ] = crc >> 8;
+	section[ out + 3 ] = crc;
+	memset( section + out + 4, 0xff, payload + length - ( section + out + 4 ) );
+}
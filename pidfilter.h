@@ -0,0 +1,73 @@
+/*
+* pidfilter.h -- Selects the packets of an MPEG-2 transport stream to keep
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DVGRAB_PIDFILTER_H
+#define DVGRAB_PIDFILTER_H
+
+#include <vector>
+#include <sys/uio.h>
+
+/** Drops the packets of unwanted PIDs from an HDV stream
+
+    Either a set of PIDs is kept, or everything but null packets. The
+    PAT, the PMT and the PCR PID of the program are always kept. The
+    PMT is rewritten without the streams that are dropped, so the
+    result is a valid transport stream of the streams that are left.
+
+    Each packet is classified by a single lookup in a table of all
+    8192 PIDs. The packets that are kept are not copied: runs of them
+    are handed out as spans of the input.
+*/
+
+class PIDFilter
+{
+public:
+	PIDFilter();
+
+	void Keep( int pid );
+	void KeepVideo();
+	void KeepAudio();
+	void SetDropNull( bool drop );
+	bool IsEnabled();
+
+	void SetStreamPIDs( int video, int audio );
+	void Filter( unsigned char *data, int length, std::vector< struct iovec > &spans );
+
+private:
+	enum { DROP, KEEP, PAT, PMT };
+
+	void Update();
+	void ProcessPAT( unsigned char *packet );
+	void ProcessPMT( unsigned char *packet );
+
+	/// what to do with the packets of each PID
+	unsigned char actions[ 0x2000 ];
+	/// the PIDs asked for
+	std::vector< int > pids;
+	bool keepVideo;
+	bool keepAudio;
+	bool dropNull;
+
+	int videoPID;
+	int audioPID;
+	int pmtPID;
+	int pcrPID;
+};
+
+#endif
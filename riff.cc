@@ -647,3 +647,37 @@ void RIFFFile::WriteRIFF( void )
 		}
 	}
 }
+
+
+/** Writes out the directory structure of a file that is still growing
+ 
+    Like WriteRIFF, this writes the type and length fields of all
+    chunks that have not been written yet. In addition it rewrites
+    the headers of all lists, because their lengths keep increasing
+    as chunks are added. Lists are not marked as written, so a later
+    WriteRIFF still writes their final lengths.
+ 
+    \note It does not write the contents of any item. Use WriteChunk to do that. */
+
+void RIFFFile::CheckpointRIFF( void )
+{
+	int i;
+	RIFFDirEntry entry;
+	int count = directory.size();
+
+	for ( i = 1; i < count; ++i )
+	{
+		entry = GetDirectoryEntry( i );
+		if ( entry.written == false || entry.name != 0 )
+		{
+			fail_if( lseek( fd, entry.offset - RIFF_HEADERSIZE, SEEK_SET ) == ( off_t ) - 1 ) ;
+			fail_neg( write( fd, &entry.type, sizeof( entry.type ) ) );
+			DWORD length = entry.length;
+			fail_neg( write( fd, &length, sizeof( length ) ) );
+			if ( entry.name != 0 )
+				fail_neg( write( fd, &entry.name, sizeof( entry.name ) ) );
+			else
+				directory[ i ].written = true;
+		}
+	}
+}
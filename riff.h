@@ -85,6 +85,7 @@ public:
 	virtual void ReadChunk( int chunk_index, void *data );
 	virtual void WriteChunk( int chunk_index, const void *data );
 	virtual void WriteRIFF( void );
+	virtual void CheckpointRIFF( void );
 
 protected:
 	int fd;
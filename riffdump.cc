@@ -1,26 +1,542 @@
+/*
+* riffdump.cc -- validate DV files written by dvgrab
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/** Validates AVI and raw DV files and prints statistics about them
+
+    Every frame is located through the index of the file, read once
+    and checked for a consistent size, a sane DIF block layout and a
+    timecode continuing the one of the previous frame. Damaged DIF
+    blocks, for example from tape dropouts, are counted. Several files
+    are checked in parallel. One line of tab separated key=value
+    pairs is printed per file, followed by a line with the totals.
+
+    With -dump the RIFF directory of a single AVI file is printed
+    instead.
+
+    \file riffdump.cc
+*/
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
 
-#include <stdio.h>
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using std::string;
+using std::ostringstream;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include "error.h"
 #include "riff.h"
 #include "avi.h"
+#include "dvframe.h"
+
+typedef struct
+{
+	FOURCC type;
+	DWORD length;
+}
+PACKED(ChunkHeader);
+
+
+/** The findings about one file
+
+*/
+
+class Report
+{
+public:
+	/// avi1, avi2 or raw
+	string format;
+	/// odml, idx1 or none
+	string index;
+	int frames;
+	off_t bytes;
+	/// frames whose DIF blocks are not where they belong
+	int badFrames;
+	/// index entries which do not point to a DV frame chunk inside the file
+	int indexErrors;
+	/// frames whose size differs from the first one
+	int sizeErrors;
+	int timeCodeMissing;
+	int timeCodeBreaks;
+	/// frames with damaged DIF blocks, see DVFrame::GetDamage
+	int damagedFrames;
+	int damagedBlocks;
+	/// bytes after the last frame or RIFF list, negative if the file is truncated
+	off_t trailing;
+	TimeCode firstTimeCode;
+	TimeCode lastTimeCode;
+	/// why the file could not be checked at all
+	string error;
+
+	Report() : frames( 0 ), bytes( 0 ), badFrames( 0 ), indexErrors( 0 ), sizeErrors( 0 ),
+			timeCodeMissing( 0 ), timeCodeBreaks( 0 ), damagedFrames( 0 ), damagedBlocks( 0 ),
+			trailing( 0 ), haveTimeCode( false )
+	{}
+
+	bool IsOK( void ) const
+	{
+		return error.empty() && badFrames == 0 && indexErrors == 0 && sizeErrors == 0 && trailing >= 0;
+	}
+
+	void CheckFrame( DVFrame &frame, int size );
+
+private:
+	bool haveTimeCode;
+};
+
+
+/** Advances a timecode by one frame
+
+    \param tc the timecode to advance
+    \param isPAL true for 25 frames per second, false for 30
+    \param dropFrame skip frames 0 and 1 of every minute not divisible by ten
+*/
+
+static void NextTimeCode( TimeCode &tc, bool isPAL, bool dropFrame )
+{
+	if ( ++tc.frame < ( isPAL ? 25 : 30 ) )
+		return;
+	tc.frame = 0;
+	if ( ++tc.sec < 60 )
+		return;
+	tc.sec = 0;
+	if ( ++tc.min < 60 )
+	{
+		if ( dropFrame && tc.min % 10 != 0 )
+			tc.frame = 2;
+		return;
+	}
+	tc.min = 0;
+	if ( ++tc.hour == 24 )
+		tc.hour = 0;
+}
+
 
-int main (int argc, char *argv[])
+static bool operator==( const TimeCode &a, const TimeCode &b )
 {
-        try {
-                AVIFile avi;
-                avi.Open(argv[1]);
-                avi.ParseRIFF();
-                avi.PrintDirectory();
-        } catch (char *s) {
-                printf("Exception caught.\n%s\n", s);
-        }
+	return a.hour == b.hour && a.min == b.min && a.sec == b.sec && a.frame == b.frame;
+}
+
+
+/** Checks one frame and adds it to the statistics
+
+    \param frame the frame, its data must be filled in
+    \param size the number of bytes read into the frame
+*/
+
+void Report::CheckFrame( DVFrame &frame, int size )
+{
+	++frames;
+	bytes += size;
+
+	if ( size != DVFrame::FrameSize( frame.data, size ) || !DVFrame::IsValidFrame( frame.data, size ) )
+	{
+		++badFrames;
+		return;
+	}
 
-        catch (...) {
-                printf("Unexpected exception caught.\n");
-        }
+	TimeCode tc;
+	bool isPAL = size == 144000;
 
-        return 0;
+	frame.SetDataLen( size );
+
+	int damaged = frame.GetDamage();
+	if ( damaged > 0 )
+	{
+		++damagedFrames;
+		damagedBlocks += damaged;
+	}
+
+	if ( !frame.GetTimeCode( tc ) || tc.hour > 23 || tc.min > 59 || tc.sec > 59 || tc.frame >= ( isPAL ? 25 : 30 ) )
+	{
+		++timeCodeMissing;
+		return;
+	}
+	if ( haveTimeCode )
+	{
+		TimeCode expected = lastTimeCode;
+		NextTimeCode( expected, isPAL, false );
+		if ( !( tc == expected ) )
+		{
+			expected = lastTimeCode;
+			NextTimeCode( expected, isPAL, !isPAL );
+			if ( !( tc == expected ) )
+				++timeCodeBreaks;
+		}
+	}
+	else
+	{
+		firstTimeCode = tc;
+		haveTimeCode = true;
+	}
+	lastTimeCode = tc;
 }
 
+
+/** Checks every frame listed in the index of an AVI file
+
+    \param filename the file to check
+    \param fd the file opened for reading the frames
+    \param fileSize the size of the file
+    \param frame a frame buffer to use
+    \param report receives the findings
+*/
+
+static void CheckAVI( const char *filename, int fd, off_t fileSize, DVFrame &frame, Report &report )
+{
+	AVIFile avi;
+	off_t end = 0;
+	int expectedSize = 0;
+
+	fail_if( !avi.Open( filename ) );
+	avi.ParseRIFF();
+	if ( !( avi.verifyStreamFormat( make_fourcc( "dvsd" ) ) || avi.verifyStreamFormat( make_fourcc( "dv25" ) ) ) )
+	{
+		report.error = "not a DV AVI file";
+		return;
+	}
+	avi.ReadIndex();
+	report.format = avi.verifyStream( make_fourcc( "auds" ) ) ? "avi2" : "avi1";
+	if ( avi.FindDirectoryEntry( make_fourcc( "indx" ) ) != -1 )
+		report.index = "odml";
+	else if ( avi.FindDirectoryEntry( make_fourcc( "idx1" ) ) != -1 )
+		report.index = "idx1";
+	else
+	{
+		report.index = "none";
+		report.error = "no index";
+		return;
+	}
+
+	/* the RIFF lists must account for the whole file */
+
+	for ( int i = 0, list; ( list = avi.FindDirectoryEntry( make_fourcc( "RIFF" ), i ) ) != -1; ++i )
+	{
+		RIFFDirEntry entry = avi.GetDirectoryEntry( list );
+		if ( entry.offset + entry.length > end )
+			end = entry.offset + entry.length;
+	}
+	report.trailing = fileSize - end;
+
+	int totalFrames = avi.GetTotalFrames();
+	off_t previous = 0;
+
+	for ( int i = 0; i < totalFrames; ++i )
+	{
+		ChunkHeader header;
+		struct iovec iov[ 2 ];
+		off_t offset;
+		int size;
+
+		if ( avi.GetFrameInfo( offset, size, i ) != 0 || size <= 0 || size > DATA_BUFFER_LEN ||
+		        offset <= previous || offset + size > fileSize )
+		{
+			++report.indexErrors;
+			continue;
+		}
+		previous = offset;
+		if ( expectedSize == 0 )
+			expectedSize = size;
+		else if ( size != expectedSize )
+			++report.sizeErrors;
+
+		/* the index must point right behind a matching chunk header */
+
+		iov[ 0 ].iov_base = &header;
+		iov[ 0 ].iov_len = sizeof( header );
+		iov[ 1 ].iov_base = frame.data;
+		iov[ 1 ].iov_len = size;
+		if ( preadv( fd, iov, 2, offset - RIFF_HEADERSIZE ) != ( ssize_t ) sizeof( header ) + size )
+		{
+			++report.indexErrors;
+			continue;
+		}
+		if ( ( header.type != make_fourcc( "00__" ) && header.type != make_fourcc( "00dc" ) &&
+		        header.type != make_fourcc( "00db" ) ) || ( int ) header.length != size )
+			++report.indexErrors;
+
+		report.CheckFrame( frame, size );
+	}
+}
+
+
+/** Checks every frame of a raw DV file
+
+    \param fd the file
+    \param fileSize the size of the file
+    \param frame a frame buffer to use
+    \param report receives the findings
+*/
+
+static void CheckRaw( int fd, off_t fileSize, DVFrame &frame, Report &report )
+{
+	int size = 0;
+	off_t offset;
+
+	report.format = "raw";
+	report.index = "none";
+
+	for ( offset = 0; offset < fileSize; offset += size )
+	{
+		/* the first DIF sequence tells the size of the frame, from then on
+		   all frames are expected to have the same size */
+
+		if ( size == 0 )
+		{
+			if ( pread( fd, frame.data, 4, 0 ) != 4 )
+				break;
+			size = DVFrame::FrameSize( frame.data, 4 );
+		}
+		if ( fileSize - offset < size )
+			break;
+		if ( pread( fd, frame.data, size, offset ) != size )
+			break;
+		report.CheckFrame( frame, size );
+	}
+	report.trailing = fileSize - offset;
+	if ( report.trailing != 0 )
+		++report.sizeErrors;
+}
+
+
+/** Checks a file
+
+    \param filename the file to check
+    \param frame a frame buffer to use
+    \param report receives the findings
+*/
+
+static void CheckFile( const char *filename, DVFrame &frame, Report &report )
+{
+	struct stat st;
+	char magic[ 12 ];
+	int fd = open( filename, O_RDONLY );
+
+	if ( fd == -1 )
+	{
+		report.error = strerror( errno );
+		return;
+	}
+	try
+	{
+		fail_neg( fstat( fd, &st ) );
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+		if ( pread( fd, magic, sizeof( magic ), 0 ) == sizeof( magic ) &&
+		        memcmp( magic, "RIFF", 4 ) == 0 && memcmp( magic + 8, "AVI ", 4 ) == 0 )
+			CheckAVI( filename, fd, st.st_size, frame, report );
+		else
+			CheckRaw( fd, st.st_size, frame, report );
+	}
+	catch ( string exc )
+	{
+		report.error = exc;
+	}
+	close( fd );
+}
+
+
+static string FormatTimeCode( const TimeCode &tc )
+{
+	char s[ 12 ];
+
+	snprintf( s, sizeof( s ), "%2.2d:%2.2d:%2.2d:%2.2d", tc.hour, tc.min, tc.sec, tc.frame );
+	return s;
+}
+
+
+/** The list of files shared by the worker threads
+
+*/
+
+class Sweep
+{
+public:
+	vector< const char * > files;
+	int next;
+	int failed;
+	int frames;
+	off_t bytes;
+	pthread_mutex_t mutex;
+
+	Sweep() : next( 0 ), failed( 0 ), frames( 0 ), bytes( 0 )
+	{
+		pthread_mutex_init( &mutex, NULL );
+	}
+
+	~Sweep()
+	{
+		pthread_mutex_destroy( &mutex );
+	}
+};
+
+
+static void *CheckFiles( void *arg )
+{
+	Sweep *sweep = static_cast< Sweep* >( arg );
+	DVFrame *frame = new DVFrame;
+
+	while ( true )
+	{
+		const char *filename;
+		Report report;
+
+		pthread_mutex_lock( &sweep->mutex );
+		filename = sweep->next < ( int ) sweep->files.size() ? sweep->files[ sweep->next++ ] : NULL;
+		pthread_mutex_unlock( &sweep->mutex );
+		if ( filename == NULL )
+			break;
+
+		CheckFile( filename, *frame, report );
+
+		ostringstream line;
+		line << "file\tstatus=" << ( report.IsOK() ? "ok" : "bad" );
+		if ( report.error.empty() )
+		{
+			line << "\tformat=" << report.format
+			<< "\tindex=" << report.index
+			<< "\tframes=" << report.frames
+			<< "\tbytes=" << report.bytes
+			<< "\tbad_frames=" << report.badFrames
+			<< "\tindex_errors=" << report.indexErrors
+			<< "\tsize_errors=" << report.sizeErrors
+			<< "\ttrailing=" << report.trailing
+			<< "\ttc_missing=" << report.timeCodeMissing
+			<< "\ttc_breaks=" << report.timeCodeBreaks
+			<< "\tdamaged_frames=" << report.damagedFrames
+			<< "\tdamaged_blocks=" << report.damagedBlocks;
+			if ( report.frames > report.timeCodeMissing + report.badFrames )
+				line << "\ttc_first=" << FormatTimeCode( report.firstTimeCode )
+				<< "\ttc_last=" << FormatTimeCode( report.lastTimeCode );
+		}
+		else
+		{
+			line << "\terror=" << report.error;
+		}
+		line << "\tname=" << filename << endl;
+
+		pthread_mutex_lock( &sweep->mutex );
+		cout << line.str() << std::flush;
+		if ( !report.IsOK() )
+			++sweep->failed;
+		sweep->frames += report.frames;
+		sweep->bytes += report.bytes;
+		pthread_mutex_unlock( &sweep->mutex );
+	}
+	delete frame;
+	return NULL;
+}
+
+
+static int Dump( const char *filename )
+{
+	AVIFile avi;
+
+	fail_if( !avi.Open( filename ) );
+	avi.ParseRIFF();
+	avi.PrintDirectory();
+	return EXIT_SUCCESS;
+}
+
+
+static void usage( const char *name )
+{
+	cerr << "Usage: " << name << " [-jobs num] file..." << endl;
+	cerr << "       " << name << " -dump file.avi" << endl << endl;
+	cerr << "Checks the index, frame sizes, DIF blocks and timecode of AVI and raw DV files." << endl;
+	cerr << "Prints one line of tab separated key=value pairs per file and one with the totals." << endl << endl;
+	cerr << "  -jobs num            number of files to check at the same time" << endl;
+	cerr << "                          (default is the number of processors)" << endl;
+	cerr << "  -dump                print the RIFF directory of an AVI file" << endl;
+}
+
+
+int main( int argc, char *argv[] )
+{
+	Sweep sweep;
+	int jobs = sysconf( _SC_NPROCESSORS_ONLN );
+	int i = 1;
+	struct timeval start, end;
+
+	try
+	{
+		if ( argc == 3 && strcmp( argv[ 1 ], "-dump" ) == 0 )
+			return Dump( argv[ 2 ] );
+	}
+	catch ( string exc )
+	{
+		cerr << exc << endl;
+		return EXIT_FAILURE;
+	}
+
+	if ( i + 1 < argc && strcmp( argv[ i ], "-jobs" ) == 0 )
+	{
+		jobs = atoi( argv[ i + 1 ] );
+		i += 2;
+	}
+	if ( i >= argc || jobs < 1 )
+	{
+		usage( argv[ 0 ] );
+		return EXIT_FAILURE;
+	}
+	for ( ; i < argc; ++i )
+		sweep.files.push_back( argv[ i ] );
+	if ( jobs > ( int ) sweep.files.size() )
+		jobs = sweep.files.size();
+
+	vector< pthread_t > threads( jobs );
+
+	gettimeofday( &start, NULL );
+	for ( i = 0; i < jobs; ++i )
+		fail_neg( pthread_create( &threads[ i ], NULL, CheckFiles, &sweep ) );
+	for ( i = 0; i < jobs; ++i )
+		pthread_join( threads[ i ], NULL );
+	gettimeofday( &end, NULL );
+
+	double seconds = ( end.tv_sec - start.tv_sec ) + ( end.tv_usec - start.tv_usec ) / 1000000.0;
+	cout << "total\tfiles=" << sweep.files.size()
+	<< "\tbad=" << sweep.failed
+	<< "\tframes=" << sweep.frames
+	<< "\tbytes=" << sweep.bytes
+	<< "\tseconds=" << seconds
+	<< "\tMBps=" << ( seconds > 0 ? sweep.bytes / seconds / 1000000.0 : 0 ) << endl;
+
+	return sweep.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+/*
+* scene.cc -- Scene cut detection in the compressed domain
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "scene.h"
+
+/// a cut must also stand out this many times from the recent changes
+#define SCENE_CONTRAST 3
+
+/// HDV complexity changes are larger than DV picture changes by this factor
+#define SCENE_HDV_SCALE 5
+
+
+SceneDetector::SceneDetector() :
+		threshold( 0 ), framesSinceCut( 0 ), current( 0 ), lastHeight( 0 ), averageChange( 0 ),
+		intraComplexity( 0 ), averagePredicted( 0 ), isCutPending( false )
+{}
+
+
+/** Sets the sensitivity
+
+    \param percent the smallest change of the picture, in percent, that
+    can be a cut. 0 turns the detection off.
+*/
+
+void SceneDetector::SetThreshold( int percent )
+{
+	threshold = percent;
+}
+
+
+int SceneDetector::GetThreshold()
+{
+	return threshold;
+}
+
+
+/** Feeds the next frame to the detector
+
+    Scenes are at least a second long, so a flash or a burst of noise
+    does not cause a row of cuts. HDV is only cut at a GOP.
+
+    \param frame the next frame of the stream
+    \return true if a new scene starts with this frame
+*/
+
+bool SceneDetector::IsSceneCut( Frame *frame )
+{
+	int minimum = frame->GetFrameRate() > 0 ? ( int ) ( frame->GetFrameRate() + 0.5 ) : 25;
+	bool cut = frame->IsHDV() ? CompareHDV( ( HDVFrame* ) frame ) : CompareDV( ( DVFrame* ) frame );
+
+	if ( ++framesSinceCut < minimum || !cut )
+		return false;
+	framesSinceCut = 0;
+	return true;
+}
+
+
+/** Compares the DC picture of a DV frame to the previous one
+
+    The change is the mean absolute difference of the luma of all 8x8
+    blocks plus half that of both chroma components, in percent of the
+    video range. Camera and subject motion keep the recent average
+    high, so only a change that also stands out from it is a cut.
+*/
+
+bool SceneDetector::CompareDV( DVFrame *frame )
+{
+	unsigned char *picture = dc[ current ];
+	unsigned char *previous = dc[ !current ];
+	int height = frame->ExtractDC( picture );
+	bool cut = false;
+
+	if ( height == lastHeight )
+	{
+		int pixels = DV_DC_WIDTH * height;
+		int luma = 0;
+		int chroma = 0;
+
+		for ( int i = 0; i < pixels * 3; i += 3 )
+		{
+			luma += abs( picture[ i ] - previous[ i ] );
+			chroma += abs( picture[ i + 1 ] - previous[ i + 1 ] ) + abs( picture[ i + 2 ] - previous[ i + 2 ] );
+		}
+
+		float change = ( luma + chroma / 2 ) * 100.0f / ( pixels * 219 );
+		cut = change >= threshold && change >= SCENE_CONTRAST * averageChange;
+		if ( !cut )
+			averageChange += ( change - averageChange ) / 8;
+	}
+	lastHeight = height;
+	current = !current;
+	return cut;
+}
+
+
+/** Compares the complexity of an HDV picture to the previous ones
+
+    An I picture is compared to the previous I picture. A P picture
+    that costs as much as half an I picture and stands out from the
+    recent P pictures has its macroblocks mostly intra coded, which
+    means the scene changed within the GOP; the cut then is made at
+    the next GOP.
+*/
+
+bool SceneDetector::CompareHDV( HDVFrame *frame )
+{
+	float complexity = frame->GetPictureSize() * frame->GetQuantiser();
+	float factor = 1.0f + SCENE_HDV_SCALE * threshold / 100.0f;
+
+	if ( complexity <= 0 )
+		return false;
+
+	if ( frame->GetPictureType() == 1 )
+	{
+		if ( intraComplexity > 0 && ( complexity > intraComplexity * factor || complexity * factor < intraComplexity ) )
+			isCutPending = true;
+		intraComplexity = complexity;
+	}
+	else if ( frame->GetPictureType() == 2 )
+	{
+		if ( averagePredicted > 0 && complexity > averagePredicted * factor && 2 * complexity > intraComplexity )
+			isCutPending = true;
+		else if ( averagePredicted > 0 )
+			averagePredicted += ( complexity - averagePredicted ) / 8;
+		else
+			averagePredicted = complexity;
+	}
+
+	if ( !isCutPending || !frame->CanStartNewStream() )
+		return false;
+	isCutPending = false;
+	return true;
+}
@@ -0,0 +1,63 @@
+/*
+* scene.h -- Scene cut detection in the compressed domain
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DVGRAB_SCENE_H
+#define DVGRAB_SCENE_H
+
+#include "dvframe.h"
+#include "hdvframe.h"
+
+/** Finds the cuts in material that carries no new recording flag
+
+    Tapes dubbed from another source have continuous timecode and
+    recording dates, so cuts are found in the picture content. Nothing
+    is decoded: DV frames are compared by their DC coefficients, HDV by
+    the coded size and quantiser of the pictures. Every frame must be
+    passed in, in order, for the history to be right.
+*/
+
+class SceneDetector
+{
+public:
+	SceneDetector();
+
+	void SetThreshold( int percent );
+	int GetThreshold();
+	bool IsSceneCut( Frame *frame );
+
+private:
+	bool CompareDV( DVFrame *frame );
+	bool CompareHDV( HDVFrame *frame );
+
+	int threshold;
+	int framesSinceCut;
+
+	// DV: the DC pictures of this and the previous frame
+	unsigned char dc[ 2 ][ DV_DC_WIDTH * DV_DC_HEIGHT * 3 ];
+	int current;
+	int lastHeight;
+	float averageChange;
+
+	// HDV: coded size times quantiser, a measure of picture complexity
+	float intraComplexity;
+	float averagePredicted;
+	bool isCutPending;
+};
+
+#endif
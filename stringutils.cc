@@ -94,3 +94,23 @@ string StringUtils::toUpper( string s )
 	transform( s.begin(), s.end(), s.begin(), (int(*)(int)) toupper );
 	return s;
 }
+
+/** Replaces the extension of a file name
+
+    A dot in a directory name does not start an extension. A name
+    without an extension gets one.
+
+    \param fileName the file name
+    \param extension the new extension, with its dot
+    \return the file name with the new extension
+*/
+
+string StringUtils::replaceExtension( string fileName, string extension )
+{
+	string::size_type slash = fileName.rfind( '/' );
+	string::size_type dot = fileName.rfind( '.' );
+
+	if ( dot == string::npos || ( slash != string::npos && dot < slash ) )
+		dot = fileName.size();
+	return fileName.substr( 0, dot ) + extension;
+}
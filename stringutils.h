@@ -35,6 +35,7 @@ public:
 	static string ltos ( long num );
 	static string toLower( string s );
 	static string toUpper( string s );
+	static string replaceExtension( string fileName, string extension );
 };
 
 #endif
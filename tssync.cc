@@ -0,0 +1,160 @@
+/*
+* tssync.cc -- Transport stream packet synchronisation
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "tssync.h"
+#include "iec13818-1.h"
+
+/// the packet sizes to look for, the common one first
+static const int packetSizes[] = { HDV_PACKET_SIZE, 192, TS_MAX_PACKET_SIZE };
+
+
+TSSync::TSSync() :
+		start( 0 ), end( 0 ), eof( false ), isLocked( false ), packetSize( 0 ), skipped( 0 )
+{}
+
+
+/** Reads the next packet
+
+    \param file the stream
+    \param packet receives the 188 bytes of the packet, from the sync byte on
+    \return false at the end of the stream
+*/
+
+bool TSSync::Read( FILE *file, unsigned char *packet )
+{
+	while ( true )
+	{
+		if ( !eof && end - start < ( TS_SYNC_PACKETS - 1 ) * TS_MAX_PACKET_SIZE + HDV_PACKET_SIZE )
+			Fill( file );
+
+		if ( !isLocked && !Lock() )
+		{
+			if ( eof && end - start < HDV_PACKET_SIZE )
+				return false;
+			continue;
+		}
+
+		if ( end - start < HDV_PACKET_SIZE )
+			return false;
+
+		if ( buffer[ start ] != HDV_PACKET_MARKER )
+		{
+			isLocked = false;
+			continue;
+		}
+
+		memcpy( packet, &buffer[ start ], HDV_PACKET_SIZE );
+		start += end - start < packetSize ? end - start : packetSize;
+		return true;
+	}
+}
+
+
+/// The size of the packets in the stream, 0 until it is known
+int TSSync::GetPacketSize()
+{
+	return packetSize;
+}
+
+
+void TSSync::Fill( FILE *file )
+{
+	memmove( buffer, &buffer[ start ], end - start );
+	end -= start;
+	start = 0;
+
+	size_t wanted = TS_SYNC_BUFFER_SIZE - end;
+	size_t n = fread( &buffer[ end ], 1, wanted, file );
+	end += n;
+	if ( n < wanted )
+		eof = true;
+}
+
+
+/** Searches the buffer for the start of a run of packets
+
+    The bytes in front of it are dropped. Near the end of the buffer the
+    search stops until more data has been read, except at the end of the
+    stream, where the packets that are left are enough.
+
+    \return true if start is at the first packet of the run
+*/
+
+bool TSSync::Lock()
+{
+	int position = start;
+	unsigned char *p;
+
+	while ( ( p = ( unsigned char* ) memchr( &buffer[ position ], HDV_PACKET_MARKER, end - position ) ) != NULL )
+	{
+		position = p - buffer;
+		if ( !eof && end - position < ( TS_SYNC_PACKETS - 1 ) * TS_MAX_PACKET_SIZE + HDV_PACKET_SIZE )
+			break;
+
+		for ( unsigned int i = 0; i < sizeof( packetSizes ) / sizeof( packetSizes[ 0 ] ); i++ )
+		{
+			if ( IsSynced( position, packetSizes[ i ] ) )
+			{
+				// A stream may well start in the middle of a packet
+				skipped += position - start;
+				start = position;
+				if ( packetSize && skipped > 0 )
+					sendEvent( "TS packet sync lost, skipped %lld bytes", ( long long ) skipped );
+				if ( packetSizes[ i ] != packetSize && packetSizes[ i ] != HDV_PACKET_SIZE )
+					sendEvent( "Reading %d byte TS packets", packetSizes[ i ] );
+				packetSize = packetSizes[ i ];
+				isLocked = true;
+				skipped = 0;
+				return true;
+			}
+		}
+		position++;
+	}
+	if ( p == NULL )
+		position = end;
+
+	skipped += position - start;
+	start = position;
+	return false;
+}
+
+
+/** Checks for sync bytes at a packet size
+
+    \param position the first sync byte
+    \param size the packet size
+    \return true if the following TS_SYNC_PACKETS - 1 packets, as far as
+    the stream goes, start with a sync byte
+*/
+
+bool TSSync::IsSynced( int position, int size )
+{
+	if ( position + HDV_PACKET_SIZE > end )
+		return false;
+	for ( int i = 1; i < TS_SYNC_PACKETS && position + i * size < end; i++ )
+		if ( buffer[ position + i * size ] != HDV_PACKET_MARKER )
+			return false;
+	return true;
+}
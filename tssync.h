@@ -0,0 +1,69 @@
+/*
+* tssync.h -- Transport stream packet synchronisation
+* Copyright (C) 2026 Dan Dennedy <dan@dennedy.org>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software Foundation,
+* Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DVGRAB_TSSYNC_H
+#define DVGRAB_TSSYNC_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/// the largest packet: 188 bytes followed by 16 bytes Reed-Solomon parity
+#define TS_MAX_PACKET_SIZE 204
+
+/// this many sync bytes in a row at the packet size make a lock
+#define TS_SYNC_PACKETS 5
+
+#define TS_SYNC_BUFFER_SIZE ( 256 * TS_MAX_PACKET_SIZE )
+
+/** Finds the transport stream packets in a byte stream
+
+    HDVFrame wants 188 byte packets that start at the sync byte. A
+    stream from a pipe or file may start in the middle of a packet,
+    lose bytes on the way, or use 192 byte packets with a timestamp in
+    front (M2TS) or 204 byte packets with parity at the end (DVB). The
+    packet size is locked onto after a number of sync bytes in a row
+    and the extra bytes are dropped. When the sync byte is missing the
+    stream is searched again from there on, at most once per byte.
+*/
+
+class TSSync
+{
+public:
+	TSSync();
+
+	bool Read( FILE *file, unsigned char *packet );
+	int GetPacketSize();
+
+private:
+	void Fill( FILE *file );
+	bool Lock();
+	bool IsSynced( int position, int size );
+
+	unsigned char buffer[ TS_SYNC_BUFFER_SIZE ];
+	int start;
+	int end;
+	bool eof;
+
+	bool isLocked;
+	// 0 until the first lock
+	int packetSize;
+	off_t skipped;
+};
+
+#endif